@@ -8,28 +8,206 @@ Due Date: 10/25/23
 Description: Code for Phase 3 of our operating systems kernel that implements
 the syscalls for Spawn, Wait, Terminate, SemCreate, SemP, SemV, GetTimeOfDay,
 CPUTime, and GetPid. Phase 3 initializes the syscall vector with function pointers
-to our implementations and uses mailboxes to block and unblock processes and 
-acquire mutexes.  
+to our implementations and uses blockMe() and unblockProc() to block and unblock
+processes. Mutual exclusion inside the kernel comes from critical sections that
+disable interrupts.
 
 To compile with testcases, run the Makefile. 
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <usloss.h>
 #include "phase1.h"
 #include "phase2.h"
 #include "phase3.h"
 #include "phase3_usermode.h"
 
+// A semaphore id is the table index in the low bits plus a generation tag in
+// the high bits, which changes every time the slot is freed.
+#define SEM_INDEX_BITS 16
+#define SEM_INDEX_MASK ((1 << SEM_INDEX_BITS) - 1)
+#define SEM_GEN_MASK   0x7fff
+
+// statuses passed to blockMe() by phase 3, as shown by dumpProcesses()
+#define BLOCKED_SEM   30 // waiting on a semaphore
+#define BLOCKED_FUTEX 32 // waiting in FutexWait
+#define BLOCKED_WAIT  33 // waiting in kernWaitChild or kernWaitMany for a child to terminate
+#define BLOCKED_ANY   34 // waiting in kernWaitAny
+#define BLOCKED_SYNC  35 // waiting on an RWLock, condition variable, barrier or flags
+
+// PCB.waitKind for a process in kernCondWait. Releasing the semaphore may switch
+// to a process that signals the condition before the waiter has blocked.
+#define COND_WAITING  1 // queued, not blocked yet
+#define COND_BLOCKED  2 // queued and blocked in blockMe()
+#define COND_SIGNALED 3 // signaled before it blocked, so it must not block
+
+// PCB.exitState, as a spawned process goes through kernTerminate
+#define EXIT_RUNNING  0
+#define EXIT_POSTED   1 // exit recorded with the parent; still joining children
+#define EXIT_READY    2 // about to call quit(), so join() will not wait long for it
+
+// how many times a waiter for several units can be overtaken by later, smaller
+// requests before the semaphore saves every unit for it
+#define SEM_MAX_BYPASS 4
+
+// process priorities run from 1 (highest) to SEM_PRIO_LEVELS; phase 1 does not
+// report a process's priority, so one phase 3 did not spawn, such as start3, is
+// taken to run at DEFAULT_PRIORITY
+#define SEM_PRIO_LEVELS  5
+#define DEFAULT_PRIORITY 3
+
+// number of hash buckets for futex waiters; must be a power of two
+#define FUTEX_BUCKETS 64
+
+// number of semaphores dumpSemStats() lists
+#define SEM_HOT_COUNT 10
+
+// bytes trimmed off the low end of a process's recorded stack range, so an
+// address in a neighbouring allocation is never mistaken for part of it
+#define STACK_GUARD 1024
+
+// length of a SemPTimeout() tick, the period of the USLOSS clock interrupt
+#define TICK_US (USLOSS_CLOCK_MS * 1000)
+
+// Semaphores live in fixed-size chunks reached through a directory, so the
+// table can grow without moving records that blocked processes point into.
+// Enough chunks to hold MAXSEMS are allocated statically.
+#define SEM_CHUNK_BITS    6
+#define SEM_CHUNK_SIZE    (1 << SEM_CHUNK_BITS)
+#define SEM_CHUNK_MASK    (SEM_CHUNK_SIZE - 1)
+#define SEM_MAX_CHUNKS    (SEM_TABLE_LIMIT / SEM_CHUNK_SIZE)
+#define SEM_STATIC_CHUNKS ((MAXSEMS + SEM_CHUNK_SIZE - 1) / SEM_CHUNK_SIZE)
+
+typedef struct ExitRecord {
+    int pid;
+    int status;
+    int joined; // set if join() already returned this child to another wait call
+} ExitRecord;
+
+// One entry on a semaphore's wait queue. A process normally waits through the
+// entry in its PCB; WaitAny puts one entry on each of several queues.
+typedef struct SemWaiter {
+    struct PCB* proc;
+    struct Semaphore* sem; // semaphore whose wait queue holds this entry, or NULL
+    struct SemWaiter* next;
+    struct SemWaiter* prev;
+    int need;     // units wanted
+    int bypassed; // times overtaken by a later waiter on the same queue
+    int priority; // place in the queue of a SEM_PRIORITY semaphore
+} SemWaiter;
+
 typedef struct PCB {
     int (*startFunc)(char*);
     char* arg;
     int pid;
-    int mboxNum;
     int filled;
-    struct PCB* nextBlockedProc;
+    SemWaiter semWait; // entry used by SemP and friends
+    int wakeResult; // 0 if woken with a unit, -1 if the semaphore was freed
+    int deadline;   // currentTime() at which a timed wait gives up
+    int timerIndex; // position in timerHeap, or -1 if no timer is armed
+    int* futexAddr; // address waited on in FutexWait, or NULL
+    int stackSize;
+    int basePriority; // priority given to Spawn, or 0 if not spawned
+    int priority;     // basePriority, or higher while inherited through a semaphore
+    char* stackLo;  // bounds of the stack, as published in phase3DataPage
+    char* stackHi;
+    struct PCB* nextFutexWaiter;
+    struct SemOpReq* semOp;      // pending SemOp while blocked in kernSemOp
+    struct PCB* nextSemOpWaiter;
+    int parentPid;    // process that spawned this one, or 0 if not spawned
+    int liveChildren; // spawned children that have not called Terminate
+    int waitFor;      // while blocked waiting for a child: the child pid, or -1 for any
+    ExitRecord exited[MAXPROC]; // children that terminated but were not waited for
+    int numExited;
+    int reported[MAXPROC]; // children whose status was returned but not yet join()ed
+    int numReported;
+    int exitState;
+    struct WaitAnyReq* waitAny; // pending WaitAny while blocked in kernWaitAny
+    struct PCB* nextWaiter; // link in a WaitQueue
+    int waitKind;           // what the process wants from the object it waits on
+    unsigned int waitMask;  // event flags waited for; the flags seen once woken
+    int readHolds[MAXRWLOCKS]; // read holds on each RWLock not yet released
+    int syscall;   // number of the syscall being handled, or -1
+    int lockDepth; // acquireLock() calls not yet released
+    int lockStart; // readtime() at the outermost acquireLock()
+    int lockSlot;  // lockStats entry charged until the outermost releaseLock()
+    struct Semaphore* owned; // SEM_INHERIT semaphores this process owns
 } PCB;
 
+// FIFO queue of processes blocked on an RWLock, condition variable, barrier or
+// event flag group, linked through PCB.nextWaiter
+typedef struct WaitQueue {
+    struct PCB* head;
+    struct PCB* tail;
+} WaitQueue;
+
+typedef struct RWLock {
+    int inUse;
+    int flags;          // RWLOCK_WRITER_PREF
+    int readers;        // processes holding the lock for reading
+    int writer;         // PID holding the lock for writing, or 0
+    int waitingReaders;
+    int waitingWriters;
+    WaitQueue waiters;  // readers and writers, in arrival order
+} RWLock;
+
+typedef struct CondVar {
+    int inUse;
+    WaitQueue waiters;
+} CondVar;
+
+typedef struct Barrier {
+    int inUse;
+    int parties;    // processes that must arrive to release the barrier
+    int arrived;    // processes waiting in the current generation
+    int generation; // times the barrier has been released
+    WaitQueue waiters;
+} Barrier;
+
+typedef struct FlagGroup {
+    int inUse;
+    unsigned int bits;
+    WaitQueue waiters;
+} FlagGroup;
+
+typedef struct Semaphore {
+    int value;
+    int numWaiters;
+    SemWaiter* head; // wait queue, in FIFO or priority order
+    SemWaiter* tail;
+    SemWaiter* prioTail[SEM_PRIO_LEVELS]; // last waiter of each priority
+    int flags; // SEM_PRIORITY, SEM_INHERIT
+    int owner; // PID that last took a unit, for SEM_INHERIT
+    struct Semaphore* nextOwned; // links in the owner's PCB.owned list
+    struct Semaphore* prevOwned;
+    SemStats stats;
+    int inUse;
+    int generation;
+    int nextFree; // index of the next slot on the free list, or -1
+} Semaphore;
+
+// Start information for a child, staged by spawnChild() before fork1() runs.
+typedef struct SpawnStage {
+    int (*func)(char*);
+    int stackSize;
+    int priority;
+    int parentPid;
+    int claimed; // set if the child ran before fork1() returned and took it
+} SpawnStage;
+
+typedef struct SemOpReq {
+    int n;
+    Semaphore* sems[SEMOP_MAX];
+    int deltas[SEMOP_MAX];
+} SemOpReq;
+
+typedef struct WaitAnyReq {
+    int n;
+    SemWaiter waiters[WAITANY_MAX]; // one per semaphore, in the caller's order
+    int fired; // index of the semaphore that woke the caller, or -1 for a child
+} WaitAnyReq;
+
 void kernSpawn(USLOSS_Sysargs *arg);
 void kernWait(USLOSS_Sysargs *arg);
 void kernTerminate(USLOSS_Sysargs *arg);
@@ -39,18 +217,73 @@ void kernCPUTime(USLOSS_Sysargs* arg);
 void kernGetPID(USLOSS_Sysargs* arg);
 void kernSemP(USLOSS_Sysargs* arg);
 void kernSemV(USLOSS_Sysargs* arg);
+void kernSemFree(USLOSS_Sysargs* arg);
+void kernSemOp(USLOSS_Sysargs* arg);
+void kernSemPn(USLOSS_Sysargs* arg);
+void kernSemVn(USLOSS_Sysargs* arg);
+void kernSemTimedP(USLOSS_Sysargs* arg);
+void kernFutexWait(USLOSS_Sysargs* arg);
+void kernFutexWake(USLOSS_Sysargs* arg);
+void kernBatch(USLOSS_Sysargs* arg);
+int batchNeverBlocks(int number);
+void kernSpawnMany(USLOSS_Sysargs* arg);
+void kernWaitChild(USLOSS_Sysargs* arg);
+void kernWaitMany(USLOSS_Sysargs* arg);
+void joinReported(PCB* proc);
+void kernWaitAny(USLOSS_Sysargs* arg);
+void waitAnyFire(PCB* proc, int which);
+void semEnqueue(Semaphore* sem, SemWaiter* w);
+void semUnlink(Semaphore* sem, SemWaiter* w);
+Semaphore* semLookup(int id);
+Semaphore* semAt(int index);
+void semWake(Semaphore* sem);
+SemWaiter** semGrant(Semaphore* sem, SemWaiter** tail);
+void semWaiterListWake(SemWaiter* list);
+void phase3ClockHandler(int dev, void* arg);
+void phase3SyscallHandler(int dev, void* arg);
+void publishDataPage();
+void semOpRetry();
+void semAcquire(USLOSS_Sysargs* arg, int units, int ticks);
+void initChild(int pid, SpawnStage* stage);
+int procPriority(PCB* proc);
+void semBoost(Semaphore* sem, int priority);
+int semInheritedPriority(PCB* proc);
+void semSetOwner(Semaphore* sem, int pid);
+void kernRWLock(USLOSS_Sysargs* arg);
+void kernCond(USLOSS_Sysargs* arg);
+void kernBarrier(USLOSS_Sysargs* arg);
+void kernFlags(USLOSS_Sysargs* arg);
+void kernStats(USLOSS_Sysargs* arg);
+void traceSyscall(TraceRecord* rec);
+void traceStart(TraceRecord* rec, USLOSS_Sysargs* sysargs);
+void semRelease(USLOSS_Sysargs* arg, int units);
 
 struct PCB processTable3[MAXPROC+1];
-int semaphoresList[MAXSEMS]; // array containing semaphores
-struct PCB* semaphoreBlockedProc[MAXSEMS]; // array of lists of processes blocked 
-                                           // on each semaphore
-int numberOfSems;
-int mboxIdInts; // id of mailbox for enabling/disabling interrupts
+struct Semaphore* semChunks[SEM_MAX_CHUNKS]; // directory of semaphore chunks
+struct Semaphore semStaticChunks[SEM_STATIC_CHUNKS][SEM_CHUNK_SIZE];
+int numSemChunks; // number of chunks in semChunks
+int numberOfSems; // number of slots ever used in the semaphore table
+int semFreeList;  // index of the first freed slot, or -1
+struct PCB* semOpWaiters; // processes blocked in kernSemOp
+struct PCB* timerHeap[MAXPROC]; // armed timeouts, a min-heap on deadline
+int timerCount;
+void (*nextClockHandler)(int dev, void* arg); // handler installed before ours
+struct PCB* futexBuckets[FUTEX_BUCKETS]; // futex waiters, hashed by address
+void (*nextSyscallHandler)(int dev, void* arg);
+Phase3DataPage phase3DataPage; // read by user mode; see phase3_usermode.h
+SpawnStage* pendingSpawn; // the spawn whose fork1() is in progress, or NULL
+RWLock rwLocks[MAXRWLOCKS];
+CondVar condVars[MAXCONDS];
+Barrier barriers[MAXBARRIERS];
+FlagGroup flagGroups[MAXFLAGGROUPS];
+SyscallStats syscallStats[MAXSYSCALLS];
+TraceRecord traceRing[TRACE_RING_SIZE];
+int traceCount; // records ever written; traceCount % TRACE_RING_SIZE is the next slot
+LockStats lockStats[MAXSYSCALLS + 1]; // by syscall number; the last is outside any
 
 /*
 Function to initialize data structures required in Phase 3. Initializes the 
-system call vector with the system calls implemented in this file, in addition to
-the mailbox used to implement mutexes for functions.
+system call vector with the system calls implemented in this file.
 */
 void phase3_init(void) {
     systemCallVec[3] = kernSpawn;
@@ -59,16 +292,50 @@ void phase3_init(void) {
     systemCallVec[16] = kernSemCreate;
     systemCallVec[17] = kernSemP;
     systemCallVec[18] = kernSemV;
+    systemCallVec[19] = kernSemFree;
     systemCallVec[20] = kernGetTimeOfDay;
     systemCallVec[21] = kernCPUTime;
     systemCallVec[22] = kernGetPID;
+    systemCallVec[SYS_SEMOP] = kernSemOp;
+    systemCallVec[SYS_SEMPN] = kernSemPn;
+    systemCallVec[SYS_SEMVN] = kernSemVn;
+    systemCallVec[SYS_SEMTIMEDP] = kernSemTimedP;
+    systemCallVec[SYS_FUTEXWAIT] = kernFutexWait;
+    systemCallVec[SYS_FUTEXWAKE] = kernFutexWake;
+    systemCallVec[SYS_BATCH] = kernBatch;
+    systemCallVec[SYS_SPAWNMANY] = kernSpawnMany;
+    systemCallVec[SYS_WAITCHILD] = kernWaitChild;
+    systemCallVec[SYS_WAITMANY] = kernWaitMany;
+    systemCallVec[SYS_WAITANY] = kernWaitAny;
+    systemCallVec[SYS_RWLOCK] = kernRWLock;
+    systemCallVec[SYS_COND] = kernCond;
+    systemCallVec[SYS_BARRIER] = kernBarrier;
+    systemCallVec[SYS_FLAGS] = kernFlags;
+    systemCallVec[SYS_STATS] = kernStats;
 
     numberOfSems = 0;
-    mboxIdInts = MboxCreate(1, 0);
- 
+    numSemChunks = SEM_STATIC_CHUNKS;
+    for (int i = 0; i < SEM_STATIC_CHUNKS; i++) {
+        semChunks[i] = semStaticChunks[i];
+    }
+    semFreeList = -1;
+    semOpWaiters = NULL;
+    timerCount = 0;
+
     for (int i = 0; i < MAXPROC; i++) {
         processTable3[i].filled = 0;
+        processTable3[i].timerIndex = -1;
+        processTable3[i].syscall = -1;
     }
+
+    // chain in front of the clock handler to expire timeouts on every tick
+    nextClockHandler = USLOSS_IntVec[USLOSS_CLOCK_INT];
+    USLOSS_IntVec[USLOSS_CLOCK_INT] = phase3ClockHandler;
+
+    // and in front of the syscall handler, to refresh phase3DataPage
+    nextSyscallHandler = USLOSS_IntVec[USLOSS_SYSCALL_INT];
+    USLOSS_IntVec[USLOSS_SYSCALL_INT] = phase3SyscallHandler;
+    phase3DataPage.pid = -1;
 }
 
 /*
@@ -79,24 +346,316 @@ void phase3_start_service_processes(void) {
 }
 
 /*
-Has process acquire a lock by sending a message to the global one-slot mailbox.
+Sets the PSR, halting if USLOSS rejects the value.
+*/
+void setPsr(unsigned int psr) {
+    int result = USLOSS_PsrSet(psr);
+    if (result == 1) {
+        USLOSS_Console("Error: invalid PSR value for set.\n");
+        USLOSS_Halt(1);
+    }
+}
+
+/*
+Returns the lock statistics for the syscall the current process is handling,
+or for code outside any syscall. Must be called inside a critical section.
+
+Parameters:
+    proc - the current process's shadow PCB
+*/
+LockStats* lockStatsFor(PCB* proc) {
+    int n = proc->syscall;
+    return &lockStats[n >= 0 && n < MAXSYSCALLS ? n : MAXSYSCALLS];
+}
+
+/*
+Enters a kernel critical section by disabling interrupts. Since there is only
+one CPU, nothing else can run until the matching releaseLock(), unless the
+caller blocks. The outermost acquisition picks the lockStats entry of the current
+syscall and starts the hold timer; nested ones are counted against that entry.
+
+Returns: the PSR from before the call, to be passed to releaseLock()
+*/
+unsigned int acquireLock() {
+    unsigned int psr = USLOSS_PsrGet();
+    setPsr(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    if (proc->lockDepth++ == 0) {
+        // the hold is charged to one entry, whatever proc->syscall is at release
+        proc->lockSlot = (int)(lockStatsFor(proc) - lockStats);
+        proc->lockStart = readtime();
+    }
+    else {
+        lockStats[proc->lockSlot].nested++;
+    }
+    lockStats[proc->lockSlot].acquisitions++;
+    return psr;
+}
+
+/*
+Leaves a kernel critical section by restoring the PSR saved by acquireLock().
+Restoring (rather than enabling) lets critical sections nest; only the outermost
+release records a hold time.
+
+Parameters:
+    psr - the value returned by the matching acquireLock()
+*/
+void releaseLock(unsigned int psr) {
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    if (proc->lockDepth > 0 && --proc->lockDepth == 0) {
+        LockStats* stats = &lockStats[proc->lockSlot];
+        int held = readtime() - proc->lockStart;
+        stats->totalHoldUs += held;
+        if (held > stats->maxHoldUs) {
+            stats->maxHoldUs = held;
+        }
+    }
+    setPsr(psr);
+}
+
+/*
+Swaps two entries of the timer heap, keeping their timerIndex fields current.
+*/
+void timerSwap(int a, int b) {
+    PCB* tmp = timerHeap[a];
+    timerHeap[a] = timerHeap[b];
+    timerHeap[b] = tmp;
+    timerHeap[a]->timerIndex = a;
+    timerHeap[b]->timerIndex = b;
+}
+
+/*
+Restores the heap order around one entry by moving it up or down.
+
+Parameters:
+    index - the position of the entry that may be out of place
+*/
+void timerFix(int index) {
+    while (index > 0 &&
+           timerHeap[index]->deadline < timerHeap[(index - 1) / 2]->deadline) {
+        timerSwap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+    while (1) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < timerCount && timerHeap[left]->deadline < timerHeap[smallest]->deadline) {
+            smallest = left;
+        }
+        if (right < timerCount && timerHeap[right]->deadline < timerHeap[smallest]->deadline) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        timerSwap(index, smallest);
+        index = smallest;
+    }
+}
+
+/*
+Arms a timeout for a process at proc->deadline. Must be called inside a
+critical section.
+
+Parameters:
+    proc - the shadow PCB of the process that will wait
+*/
+void timerInsert(PCB* proc) {
+    proc->timerIndex = timerCount;
+    timerHeap[timerCount] = proc;
+    timerCount++;
+    timerFix(proc->timerIndex);
+}
+
+/*
+Disarms a process's timeout, if it has one. Must be called inside a critical
+section.
+
+Parameters:
+    proc - the shadow PCB of the process
+*/
+void timerRemove(PCB* proc) {
+    int index = proc->timerIndex;
+    if (index < 0) {
+        return;
+    }
+    timerCount--;
+    if (index != timerCount) {
+        timerSwap(index, timerCount);
+        timerFix(index);
+    }
+    proc->timerIndex = -1;
+}
+
+/*
+Handles a timeout that has run out. A process still waiting for a child is
+woken with a result of 1. So is one still waiting on a semaphore, after it is
+taken off the queue; the units it was waiting for may now satisfy the waiters
+behind it. Must be called inside a critical section.
+
+Parameters:
+    proc - the shadow PCB whose deadline has passed
+*/
+void timerExpire(PCB* proc) {
+    if (proc->waitFor != 0) {
+        proc->waitFor = 0;
+        proc->wakeResult = 1;
+        unblockProc(proc->pid);
+        return;
+    }
+    Semaphore* sem = proc->semWait.sem;
+    if (sem == NULL) {
+        return; // already woken, just not running yet
+    }
+    semUnlink(sem, &proc->semWait);
+    proc->wakeResult = 1;
+    unblockProc(proc->pid);
+    if (sem->value > 0) {
+        semWake(sem);
+    }
+}
+
+/*
+Clock interrupt handler for Phase 3. Expires every timeout whose deadline has
+passed, only looking at the earliest deadline each time, and then passes the
+interrupt on to the handler that was installed before phase3_init().
+
+Parameters:
+    dev - the interrupting device
+    arg - the device's argument, passed through unchanged
+*/
+void phase3ClockHandler(int dev, void* arg) {
+    // the handler's own sections are not part of the syscall it interrupted
+    PCB* self = &processTable3[getpid() % MAXPROC];
+    int interrupted = self->syscall;
+    self->syscall = -1;
+
+    unsigned int psr = acquireLock();
+    int now = currentTime();
+    while (timerCount > 0 && timerHeap[0]->deadline <= now) {
+        PCB* proc = timerHeap[0];
+        timerRemove(proc);
+        timerExpire(proc);
+    }
+    releaseLock(psr);
+
+    if (nextClockHandler != NULL) {
+        nextClockHandler(dev, arg);
+    }
+
+    // the handler may have switched processes; whichever one is returning to
+    // its interrupted code now owns the data page
+    psr = acquireLock();
+    publishDataPage();
+    releaseLock(psr);
+    self->syscall = interrupted;
+}
+
+/*
+Syscall interrupt handler for Phase 3. Runs the handler installed before
+phase3_init() and records the call in the syscall statistics, then republishes
+the data page for the process that is about to return to user mode, which may
+have blocked and been switched back in.
+
+Parameters:
+    dev - the interrupting device
+    arg - the USLOSS_Sysargs of the syscall, passed through unchanged
+*/
+void phase3SyscallHandler(int dev, void* arg) {
+    TraceRecord rec; // the handler overwrites the arguments with its results
+    traceStart(&rec, (USLOSS_Sysargs*)arg);
+    PCB* proc = &processTable3[rec.pid % MAXPROC];
+    proc->syscall = rec.number;
+
+    nextSyscallHandler(dev, arg);
+
+    rec.duration = currentTime() - rec.start;
+    proc->syscall = -1; // tracing is not charged to the syscall traced
+    unsigned int psr = acquireLock();
+    traceSyscall(&rec);
+    publishDataPage();
+    releaseLock(psr);
+}
+
+/*
+Starts the trace record of a syscall about to run, copying its arguments before
+the handler overwrites them with its results.
+
+Parameters:
+    rec - the record to fill in
+    sysargs - the syscall's arguments
+*/
+void traceStart(TraceRecord* rec, USLOSS_Sysargs* sysargs) {
+    rec->pid = getpid();
+    rec->number = sysargs->number;
+    rec->args[0] = sysargs->arg1;
+    rec->args[1] = sysargs->arg2;
+    rec->args[2] = sysargs->arg3;
+    rec->args[3] = sysargs->arg4;
+    rec->args[4] = sysargs->arg5;
+    rec->start = currentTime();
+}
+
+/*
+Adds a completed syscall to its counters and latency histogram and to the trace
+ring, overwriting the oldest record once the ring is full. Must be called inside
+a critical section.
+
+Parameters:
+    rec - the completed call
 */
-void acquireLock() {
-    MboxSend(mboxIdInts, NULL, 0);
+void traceSyscall(TraceRecord* rec) {
+    if (rec->number < 0 || rec->number >= MAXSYSCALLS) {
+        return;
+    }
+    SyscallStats* stats = &syscallStats[rec->number];
+    stats->calls++;
+    stats->totalUs += rec->duration;
+    if (rec->duration > stats->maxUs) {
+        stats->maxUs = rec->duration;
+    }
+    int bucket = 0;
+    while (bucket < TRACE_BUCKETS - 1 && (rec->duration >> bucket) != 0) {
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+
+    traceRing[traceCount % TRACE_RING_SIZE] = *rec;
+    traceCount++;
 }
 
 /*
-Has process release its lock by receiving a message from the global one-slot 
-mailbox.
+Publishes the current process's pid, stack bounds, time of day and CPU time in
+phase3DataPage so user mode can read them without a trap. The sequence number is
+odd while the page is being written. Must be called inside a critical section.
 */
-void releaseLock() {
-    MboxCondRecv(mboxIdInts, NULL, 0); // Cond so it does not block if no lock
+void publishDataPage() {
+    int pid = getpid();
+    PCB* proc = &processTable3[pid % MAXPROC];
+    phase3DataPage.seq++;
+    phase3DataPage.pid = pid;
+    if (proc->filled && proc->pid == pid) {
+        phase3DataPage.stackLo = proc->stackLo;
+        phase3DataPage.stackHi = proc->stackHi;
+    }
+    else {
+        // not started by Spawn, so user mode cannot tell if the page is its own
+        phase3DataPage.stackLo = NULL;
+        phase3DataPage.stackHi = NULL;
+    }
+    phase3DataPage.timeOfDay = currentTime();
+    phase3DataPage.cpuTime = readtime();
+    phase3DataPage.seq++;
 }
 
 /*
-Trampoline function to run the user function specified by Spawn. It stores the info
-of the child process in this phase's shadow process table if this hasn't been done
-by kernSpawn, and then runs the function in user mode.
+Trampoline function to run the user function specified by Spawn. If the child runs
+before fork1() has returned to its parent, it stores its own info in this phase's
+shadow process table from the staged pendingSpawn; otherwise spawnChild() has
+already done so. Either way it never has to wait, and then runs the function in
+user mode.
 
 Parameters:
     arg - the argument to be supplied to the function to run
@@ -106,23 +665,98 @@ Returns: None
 int trampolineFunc(char *arg) {
     int pid = getpid();
     struct PCB* child = &processTable3[pid % MAXPROC];
-    if (child->filled == 0) {
-        child->pid = pid;
-        child->filled = 1;
-        child->mboxNum = MboxCreate(1, 0); // create one-slot mailbox for blocking
-
-        MboxRecv(child->mboxNum, NULL, 0); // block this process
+    unsigned int psr = acquireLock();
+    if (child->filled == 0 || child->pid != pid) {
+        // only the child of the fork1() in progress can be missing from the table
+        initChild(pid, pendingSpawn);
+        pendingSpawn->claimed = 1;
+        pendingSpawn = NULL;
     }
 
-    int result = USLOSS_PsrSet(USLOSS_PsrGet() & ~1); // enable user mode
-    if (result == 1) {
-        USLOSS_Console("Error: invalid PSR value for set.\n");
-        USLOSS_Halt(1);
-    }
+    // this frame is at the top of the stack, and the user function runs below it
+    char stackTop;
+    child->stackHi = &stackTop;
+    child->stackLo = &stackTop - child->stackSize + STACK_GUARD;
+    publishDataPage();
+    releaseLock(psr);
+
+    setPsr(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE); // enable user mode
     int status = processTable3[pid % MAXPROC].startFunc(arg);
     Terminate(status);
 }
 
+/*
+Fills in a new child's entry in the shadow process table from its staged start
+information. Must be called inside a critical section.
+
+Parameters:
+    pid - the child's PID
+    stage - the start information staged by spawnChild()
+*/
+void initChild(int pid, SpawnStage* stage) {
+    struct PCB* child = &processTable3[pid % MAXPROC];
+    child->pid = pid;
+    child->filled = 1;
+    child->startFunc = stage->func;
+    child->stackSize = stage->stackSize;
+    child->basePriority = stage->priority;
+    child->priority = stage->priority;
+    child->parentPid = stage->parentPid;
+    child->liveChildren = 0;
+    child->waitFor = 0;
+    child->numExited = 0;
+    child->numReported = 0;
+    child->exitState = EXIT_RUNNING;
+    child->syscall = -1;
+    child->owned = NULL;
+    for (int i = 0; i < MAXRWLOCKS; i++) {
+        child->readHolds[i] = 0;
+    }
+}
+
+/*
+Creates a child process that runs func in user mode. The start function is
+staged in pendingSpawn and interrupts stay disabled across fork1(), so no other
+spawn can start in between. A child with higher priority than its parent runs
+inside fork1() and takes the staged information itself; otherwise it is written
+to the shadow process table here, before the child can run.
+
+Parameters:
+    name - the new process's name
+    arg - parameter to pass to func
+    func - the user-main function
+    stackSize - the stack size for the process
+    priority - the priority of the process
+
+Returns: the PID from fork1(), negative if the process could not be created
+*/
+int spawnChild(char* name, char* arg, int (*func)(char*), int stackSize, int priority) {
+    SpawnStage stage;
+    stage.func = func;
+    stage.stackSize = stackSize;
+    stage.priority = priority;
+    stage.parentPid = getpid();
+    stage.claimed = 0;
+
+    unsigned int psr = acquireLock();
+    // counted before fork1(), since a higher priority child may finish inside it
+    PCB* parent = &processTable3[stage.parentPid % MAXPROC];
+    parent->pid = stage.parentPid;
+    parent->liveChildren++;
+
+    pendingSpawn = &stage;
+    int pid = fork1(name, trampolineFunc, arg, stackSize, priority);
+    pendingSpawn = NULL;
+    if (pid < 0) {
+        parent->liveChildren--;
+    }
+    else if (!stage.claimed) {
+        initChild(pid, &stage);
+    }
+    releaseLock(psr);
+    return pid;
+}
+
 /*
 Implementation of the syscall for Spawn that creates a new process and runs it in
 user mode. 
@@ -140,35 +774,176 @@ Returns:
     arg.arg4 - 01 if illegal values were given as input; 0 otherwise
 */
 void kernSpawn(USLOSS_Sysargs *arg) {
-    acquireLock(); // disable interrupts
     int (*func)(char*) = (int(*)(char*))arg->arg1;
     int stackSize = (int)(long)arg->arg3;
     int priority = (int)(long)arg->arg4;
 
-    releaseLock();
-    int ret = fork1(arg->arg5, trampolineFunc, arg->arg2, stackSize, priority);
-    acquireLock();
+    int ret = spawnChild(arg->arg5, arg->arg2, func, stackSize, priority);
+    arg->arg1 = (void*)(long)ret;
+    arg->arg4 = (void*)(long)0;
+}
+
+/*
+Implementation of the syscall for SpawnMany, which creates several children that
+run the same function, each with its own argument, in one trap. Children are
+named by appending their index to the name prefix. Creation stops at the first
+fork1() failure.
+
+Parameters:
+    arg.arg1 - a pointer to the SpawnManyReq describing the children
+
+Returns:
+    arg.arg1 - the number of children created; req->pids holds their PIDs, and -1
+               for each one that was not created
+    arg.arg4 - -1 if the request was invalid or no child could be created; 1 if
+               some but not all were created; 0 otherwise
+*/
+void kernSpawnMany(USLOSS_Sysargs *arg) {
+    SpawnManyReq* req = (SpawnManyReq*)arg->arg1;
+    arg->arg1 = (void*)(long)0;
+    if (req == NULL || req->func == NULL || req->pids == NULL || req->namePrefix == NULL ||
+        req->n < 1) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    int created = 0;
+    for (int i = 0; i < req->n; i++) {
+        req->pids[i] = -1;
+    }
+    while (created < req->n) {
+        char name[MAXNAME];
+        snprintf(name, MAXNAME, "%s%d", req->namePrefix, created);
+        char* childArg = req->args == NULL ? NULL : req->args[created];
+        int ret = spawnChild(name, childArg, req->func, req->stackSize, req->priority);
+        if (ret < 0) {
+            break;
+        }
+        req->pids[created] = ret;
+        created++;
+    }
 
-    struct PCB* child = &processTable3[ret % MAXPROC];
-    if (child->filled == 0) {
-        child->pid = ret;
-        child->startFunc = func;
-        child->filled = 1;
-        child->mboxNum = MboxCreate(1, 0); // create 0-slot mailbox for blocking
+    arg->arg1 = (void*)(long)created;
+    if (created == 0) {
+        arg->arg4 = (void*)(long)-1;
     }
     else {
-        child->startFunc = func;
-        releaseLock();
-        MboxSend(child->mboxNum, NULL, 0);
+        arg->arg4 = (void*)(long)(created < req->n);
     }
+}
 
-    arg->arg1 = (void*)(long)ret;
-    arg->arg4 = (void*)(long)0;
-    releaseLock();
+/*
+Removes the exit record of a child from a process's list of terminated children.
+
+Parameters:
+    proc - the parent's shadow PCB
+    index - position of the record in proc->exited
+*/
+void removeExited(PCB* proc, int index) {
+    proc->numExited--;
+    for (int i = index; i < proc->numExited; i++) {
+        proc->exited[i] = proc->exited[i + 1];
+    }
+}
+
+/*
+Returns a child's exit record to the caller and removes it. The child is added to
+proc->reported, to be cleaned up by joinReported(), unless join() already
+returned it. Must be called inside a critical section.
+
+Parameters:
+    proc - the parent's shadow PCB
+    index - position of the record in proc->exited
+    status - receives the child's status
+
+Returns: the PID of the child
+*/
+int takeExited(PCB* proc, int index, int* status) {
+    int pid = proc->exited[index].pid;
+    *status = proc->exited[index].status;
+    if (!proc->exited[index].joined) {
+        proc->reported[proc->numReported++] = pid;
+    }
+    removeExited(proc, index);
+    return pid;
+}
+
+/*
+Removes a child from a process's list of reported children, if it is there. Must
+be called inside a critical section.
+
+Parameters:
+    proc - the parent's shadow PCB
+    pid - the child join() just returned
+
+Returns: 1 if the child had been reported, 0 otherwise
+*/
+int unreport(PCB* proc, int pid) {
+    for (int i = 0; i < proc->numReported; i++) {
+        if (proc->reported[i] == pid) {
+            proc->reported[i] = proc->reported[--proc->numReported];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+Returns whether a reported child is about to quit, so join() will not block
+waiting for one that is still joining its own children. Must be called inside a
+critical section.
+
+Parameters:
+    proc - the parent's shadow PCB
+*/
+int reportedReady(PCB* proc) {
+    for (int i = 0; i < proc->numReported; i++) {
+        PCB* child = &processTable3[proc->reported[i] % MAXPROC];
+        if (child->pid == proc->reported[i] && child->exitState == EXIT_READY) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+Calls join() for the children in proc->reported that are ready to be cleaned up,
+so children returned from exit records do not linger in the phase 1 table. A child
+still joining its own children is left for a later wait call or kernTerminate. A
+child that join() hands back first is not reported; its exit record is marked so
+kernWait returns it without joining again.
+
+Parameters:
+    proc - the caller's shadow PCB
+*/
+void joinReported(PCB* proc) {
+    unsigned int psr = acquireLock();
+    while (reportedReady(proc)) {
+        releaseLock(psr);
+        int status;
+        int pid = join(&status);
+        psr = acquireLock();
+        if (pid < 0) {
+            break;
+        }
+        if (!unreport(proc, pid)) {
+            for (int i = 0; i < proc->numExited; i++) {
+                if (proc->exited[i].pid == pid) {
+                    proc->exited[i].joined = 1;
+                    break;
+                }
+            }
+        }
+    }
+    releaseLock(psr);
 }
 
 /*
 System call that calls join() and returns the PID and status that join() provides.
+A child that another wait call already join()ed is returned from its exit record
+instead; those children quit before any still waiting to be joined, so the order
+join() would have given is kept. Children already returned from exit records are
+joined silently and skipped.
 
 Parameters: USLOSS_Sysargs* arg is provided to store return values
 
@@ -178,10 +953,40 @@ Returns:
     arg.arg4 - -2 if no children; 0 otherwise
 */
 void kernWait(USLOSS_Sysargs *arg) {
+    PCB* proc = &processTable3[getpid() % MAXPROC];
     int status;
-    int ret = join(&status);
-    acquireLock();
-    
+    int ret = -1;
+
+    unsigned int psr = acquireLock();
+    for (int i = 0; i < proc->numExited; i++) {
+        if (proc->exited[i].joined) {
+            ret = proc->exited[i].pid;
+            status = proc->exited[i].status;
+            removeExited(proc, i);
+            break;
+        }
+    }
+
+    while (ret == -1) {
+        releaseLock(psr);
+        ret = join(&status);
+        psr = acquireLock();
+        if (ret == -2) {
+            break;
+        }
+        if (unreport(proc, ret)) {
+            ret = -1;
+            continue;
+        }
+        for (int i = 0; i < proc->numExited; i++) {
+            if (proc->exited[i].pid == ret) {
+                removeExited(proc, i);
+                break;
+            }
+        }
+    }
+    releaseLock(psr);
+
     if (ret == -2) {
         arg->arg4 = (void*)(long)-2;
     }
@@ -190,134 +995,2125 @@ void kernWait(USLOSS_Sysargs *arg) {
         arg->arg1 = (void*)(long)ret;
         arg->arg2 = (void*)(long)status;
     }
-    releaseLock();
 }
 
 /*
-Terminates the current process with the status specified. If the process still has
-children, will call join() until it returns -2 (no children remaining) before 
-calling quit().
+Waits for a spawned child to terminate using the exit records phase 3 keeps,
+rather than join(), so a specific child can be chosen and the caller can poll or
+give up after a timeout. The child is then cleaned up by joinReported().
 
 Parameters:
-    arg.arg1 - the status to terminate the process with
+    arg.arg1 - PID of the child to wait for, or -1 for any child
+    arg.arg2 - clock ticks to wait: 0 to return at once, negative to wait forever
 
-Returns: N/A (function never returns)
+Returns:
+    arg.arg1 - the PID of the child that terminated
+    arg.arg2 - the status of that child
+    arg.arg4 - 0 if a child was found; 1 if none has terminated yet or the time
+               ran out; -2 if the caller has no such child
 */
-void kernTerminate(USLOSS_Sysargs *arg) {
-    acquireLock();
-    int status = (int)(long)arg->arg1;
-    int joinStatus;
+void kernWaitChild(USLOSS_Sysargs *arg) {
+    int want = (int)(long)arg->arg1;
+    int ticks = (int)(long)arg->arg2;
+    PCB* proc = &processTable3[getpid() % MAXPROC];
 
-    int ret = join(&joinStatus);
-    while (ret != -2) {
-        ret = join(&joinStatus);
+    unsigned int psr = acquireLock();
+    proc->pid = getpid();
+    int timerArmed = 0;
+    while (1) {
+        for (int i = 0; i < proc->numExited; i++) {
+            if (want == -1 || proc->exited[i].pid == want) {
+                int status;
+                arg->arg1 = (void*)(long)takeExited(proc, i, &status);
+                arg->arg2 = (void*)(long)status;
+                arg->arg4 = (void*)(long)0;
+                timerRemove(proc);
+                releaseLock(psr);
+                joinReported(proc);
+                return;
+            }
+        }
+
+        int haveChild = 0;
+        if (want == -1) {
+            haveChild = proc->liveChildren > 0;
+        }
+        else if (want > 0) {
+            PCB* child = &processTable3[want % MAXPROC];
+            haveChild = child->filled && child->pid == want &&
+                child->parentPid == proc->pid && child->exitState == EXIT_RUNNING;
+        }
+        if (!haveChild) {
+            arg->arg4 = (void*)(long)-2;
+            break;
+        }
+        if (ticks == 0 || (timerArmed && proc->wakeResult == 1)) {
+            arg->arg4 = (void*)(long)1;
+            break;
+        }
+
+        if (ticks > 0 && !timerArmed) {
+            proc->deadline = currentTime() + ticks * TICK_US;
+            timerInsert(proc);
+            timerArmed = 1;
+        }
+        proc->waitFor = want;
+        proc->wakeResult = 0;
+        blockMe(BLOCKED_WAIT);
     }
-    releaseLock();
-    quit(status);
+    timerRemove(proc);
+    releaseLock(psr);
 }
 
 /*
-* Creates a semaphore with an intial value read from arg->arg1.
-* 
-* Parameters:
-*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
-*          arguments will be read and stored.
-*     arg->arg1: the initial value of the semaphore
-* Returns:
+Reaps several terminated children in one system call. Blocks until at least one
+spawned child has terminated, then returns the PID and status of every child that
+has, up to max of them. The children are then cleaned up by joinReported().
+
+Parameters:
+    arg.arg1 - array that receives the PIDs
+    arg.arg2 - array that receives the statuses
+    arg.arg3 - number of entries in each array
+
+Returns:
+    arg.arg1 - the number of children returned
+    arg.arg4 - 0 if any were returned; -2 if the caller has no children; -1 if
+               max is not positive
+*/
+void kernWaitMany(USLOSS_Sysargs *arg) {
+    int* pids = (int*)arg->arg1;
+    int* statuses = (int*)arg->arg2;
+    int max = (int)(long)arg->arg3;
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    arg->arg1 = (void*)(long)0;
+    if (max <= 0 || pids == NULL || statuses == NULL) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    unsigned int psr = acquireLock();
+    proc->pid = getpid();
+    while (proc->numExited == 0) {
+        if (proc->liveChildren == 0) {
+            arg->arg4 = (void*)(long)-2;
+            releaseLock(psr);
+            return;
+        }
+        proc->waitFor = -1;
+        blockMe(BLOCKED_WAIT);
+    }
+
+    int count = proc->numExited < max ? proc->numExited : max;
+    for (int i = 0; i < count; i++) {
+        pids[i] = proc->exited[i].pid;
+        statuses[i] = proc->exited[i].status;
+        if (!proc->exited[i].joined) {
+            proc->reported[proc->numReported++] = pids[i];
+        }
+    }
+    proc->numExited -= count;
+    for (int i = 0; i < proc->numExited; i++) {
+        proc->exited[i] = proc->exited[i + count];
+    }
+    releaseLock(psr);
+    joinReported(proc);
+
+    arg->arg1 = (void*)(long)count;
+    arg->arg4 = (void*)(long)0;
+}
+
+/*
+Ends a WaitAny: records which event woke the process and takes its entries off
+the wait queues of the other semaphores, so nothing else can wake it. Must be
+called inside a critical section, before the process is unblocked.
+
+Parameters:
+    proc - the shadow PCB of the process blocked in kernWaitAny
+    which - index of the semaphore that fired, or -1 for a terminated child
+*/
+void waitAnyFire(PCB* proc, int which) {
+    WaitAnyReq* req = proc->waitAny;
+    req->fired = which;
+    for (int i = 0; i < req->n; i++) {
+        if (req->waiters[i].sem != NULL) {
+            semUnlink(req->waiters[i].sem, &req->waiters[i]);
+        }
+    }
+    proc->waitAny = NULL;
+    proc->waitFor = 0;
+}
+
+/*
+Blocks until one of several events happens: a unit is available on one of a set
+of semaphores, or, if asked, a spawned child terminates. The process sits on the
+wait queue of every semaphore at once, through one SemWaiter per semaphore, and
+whichever event comes first removes it from the others. A unit taken this way is
+consumed, as with SemP. A terminated child is reaped as with WaitPid.
+
+Parameters:
+    arg.arg1 - array of semaphore ids; the same id may not appear twice
+    arg.arg2 - number of ids, 0 to WAITANY_MAX
+    arg.arg3 - WAITANY_CHILD to also wait for a child to terminate
+
+Returns:
+    arg.arg1 - index of the semaphore a unit was taken from, or -1 for a child
+    arg.arg2 - the PID of the terminated child
+    arg.arg3 - the status of the terminated child
+    arg.arg4 - 0 if an event happened; -1 if the arguments were invalid or the
+               semaphore at arg.arg1 was freed while the process was blocked; -2
+               if there are no semaphores and the caller has no children
+*/
+void kernWaitAny(USLOSS_Sysargs *arg) {
+    int* ids = (int*)arg->arg1;
+    int n = (int)(long)arg->arg2;
+    int wantChild = ((int)(long)arg->arg3 & WAITANY_CHILD) != 0;
+    if (n < 0 || n > WAITANY_MAX || (n > 0 && ids == NULL) || (n == 0 && !wantChild)) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    WaitAnyReq req; // lives on this stack until an event fires
+    Semaphore* sems[WAITANY_MAX];
+    req.n = n;
+    req.fired = -1;
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    unsigned int psr = acquireLock();
+    proc->pid = getpid();
+    for (int i = 0; i < n; i++) {
+        sems[i] = semLookup(ids[i]);
+        int repeated = 0;
+        for (int j = 0; j < i; j++) {
+            repeated |= sems[j] == sems[i];
+        }
+        if (sems[i] == NULL || repeated) {
+            arg->arg4 = (void*)(long)-1;
+            releaseLock(psr);
+            return;
+        }
+    }
+    arg->arg4 = (void*)(long)0;
+
+    if (wantChild && proc->numExited > 0) {
+        req.fired = -1;
+    }
+    else {
+        // the same test as the fast path of semAcquire()
+        for (int i = 0; i < n; i++) {
+            Semaphore* sem = sems[i];
+            if (sem->value >= 1 &&
+                (sem->head == NULL || sem->head->bypassed < SEM_MAX_BYPASS)) {
+                if (sem->head != NULL) {
+                    sem->head->bypassed++;
+                }
+                sem->value--;
+                semSetOwner(sem, proc->pid);
+                sem->stats.pCount++;
+                arg->arg1 = (void*)(long)i;
+                releaseLock(psr);
+                return;
+            }
+        }
+        if (n == 0 && proc->liveChildren == 0) {
+            arg->arg4 = (void*)(long)-2;
+            releaseLock(psr);
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            req.waiters[i].proc = proc;
+            req.waiters[i].need = 1;
+            req.waiters[i].bypassed = 0;
+            req.waiters[i].priority = procPriority(proc);
+            semEnqueue(sems[i], &req.waiters[i]);
+            semBoost(sems[i], req.waiters[i].priority);
+        }
+        if (wantChild && proc->liveChildren > 0) {
+            proc->waitFor = -1;
+        }
+        proc->waitAny = &req;
+        proc->wakeResult = 0;
+        int blockStart = currentTime();
+        blockMe(BLOCKED_ANY);
+
+        if (proc->wakeResult == -1) {
+            arg->arg4 = (void*)(long)-1;
+        }
+        else if (req.fired >= 0) {
+            // counted only on the semaphore the unit came from
+            SemStats* stats = &sems[req.fired]->stats;
+            int blockedUs = currentTime() - blockStart;
+            stats->pCount++;
+            stats->blocked++;
+            stats->totalBlockedUs += blockedUs;
+            if (blockedUs > stats->maxBlockedUs) {
+                stats->maxBlockedUs = blockedUs;
+            }
+        }
+    }
+
+    arg->arg1 = (void*)(long)req.fired;
+    if (req.fired == -1 && proc->numExited > 0) {
+        int status;
+        arg->arg2 = (void*)(long)takeExited(proc, 0, &status);
+        arg->arg3 = (void*)(long)status;
+        releaseLock(psr);
+        joinReported(proc);
+        return;
+    }
+    releaseLock(psr);
+}
+
+/*
+Terminates the current process with the status specified. If the process was
+spawned, its exit is recorded with its parent first, waking the parent if it is
+waiting for it in kernWaitChild, kernWaitMany or kernWaitAny, so the parent does
+not wait for this process's own children to finish. Phase 1 will not let a
+process quit() while it has children, so it then calls join() until it returns
+-2 (no children remaining) before calling quit().
+
+Parameters:
+    arg.arg1 - the status to terminate the process with
+
+Returns: N/A (function never returns)
+*/
+void kernTerminate(USLOSS_Sysargs *arg) {
+    int status = (int)(long)arg->arg1;
+    int joinStatus;
+
+    unsigned int psr = acquireLock();
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    int spawned = proc->filled && proc->pid == getpid();
+    // a later process in this slot must not inherit through these
+    while (proc->owned != NULL) {
+        semSetOwner(proc->owned, 0);
+    }
+    if (spawned && proc->parentPid > 0) {
+        PCB* parent = &processTable3[proc->parentPid % MAXPROC];
+        parent->exited[parent->numExited].pid = proc->pid;
+        parent->exited[parent->numExited].status = status;
+        parent->exited[parent->numExited].joined = 0;
+        parent->numExited++;
+        parent->liveChildren--;
+        proc->exitState = EXIT_POSTED;
+        if (parent->waitFor == -1 || parent->waitFor == proc->pid) {
+            parent->waitFor = 0;
+            if (parent->waitAny != NULL) {
+                waitAnyFire(parent, -1);
+            }
+            unblockProc(parent->pid);
+        }
+    }
+    releaseLock(psr);
+
+    int ret = join(&joinStatus);
+    while (ret != -2) {
+        ret = join(&joinStatus);
+    }
+
+    psr = acquireLock();
+    if (spawned) {
+        proc->exitState = EXIT_READY;
+    }
+    proc->filled = 0; // free the slot for reuse
+    proc->liveChildren = 0;
+    proc->numExited = 0;
+    proc->numReported = 0;
+    releaseLock(psr);
+    quit(status);
+}
+
+/*
+* Returns the priority a process waits at, between 1 and SEM_PRIO_LEVELS. Must
+* be called inside a critical section.
+*
+* Parameters:
+*     proc: the shadow PCB of the process
+*/
+int procPriority(PCB* proc) {
+    if (proc->priority < 1) {
+        return DEFAULT_PRIORITY;
+    }
+    return proc->priority > SEM_PRIO_LEVELS ? SEM_PRIO_LEVELS : proc->priority;
+}
+
+/*
+* Lends a waiter's priority to the process expected to V a SEM_INHERIT
+* semaphore: the one that last took a unit. If that process is itself waiting on
+* a priority-ordered semaphore it moves up that queue, and the loan passes on
+* along the chain. Phase 1 has no way to change a running process's priority, so
+* the loan only affects phase 3 wait queues. When the process next does a V on a
+* SEM_INHERIT semaphore, the loan is recomputed by semInheritedPriority(). Must
+* be called inside a critical section.
+*
+* Parameters:
+*     sem: the semaphore a process just started waiting on
+*     priority: the waiter's priority
+*/
+void semBoost(Semaphore* sem, int priority) {
+    for (int hops = 0; sem != NULL && (sem->flags & SEM_INHERIT) && hops < MAXPROC; hops++) {
+        PCB* owner = &processTable3[sem->owner % MAXPROC];
+        if (sem->owner <= 0 || owner->pid != sem->owner || procPriority(owner) <= priority) {
+            return;
+        }
+        owner->priority = priority;
+
+        sem = owner->semWait.sem;
+        if (sem != NULL && (sem->flags & SEM_PRIORITY)) {
+            semUnlink(sem, &owner->semWait);
+            owner->semWait.priority = priority;
+            semEnqueue(sem, &owner->semWait);
+        }
+    }
+}
+
+/*
+* Returns the priority a process should run at: its own, or that of the highest
+* priority process still waiting on a SEM_INHERIT semaphore it owns, if higher.
+* Must be called inside a critical section.
+*
+* Parameters:
+*     proc: the shadow PCB of the process
+*/
+int semInheritedPriority(PCB* proc) {
+    int priority = proc->basePriority;
+    int best = priority < 1 ? DEFAULT_PRIORITY : priority;
+    // SEM_INHERIT implies SEM_PRIORITY, so each queue's head is its best waiter
+    for (Semaphore* sem = proc->owned; sem != NULL; sem = sem->nextOwned) {
+        if (sem->head != NULL && procPriority(sem->head->proc) < best) {
+            best = procPriority(sem->head->proc);
+            priority = best;
+        }
+    }
+    return priority;
+}
+
+/*
+* Records pid as the owner of a SEM_INHERIT semaphore, moving it from the old
+* owner's PCB.owned list to the new one's. Does nothing for other semaphores.
+* Must be called inside a critical section.
+*
+* Parameters:
+*     sem: the semaphore
+*     pid: the new owner, or 0 for none
+*/
+void semSetOwner(Semaphore* sem, int pid) {
+    if (!(sem->flags & SEM_INHERIT) || sem->owner == pid) {
+        return;
+    }
+    if (sem->owner > 0) {
+        if (sem->prevOwned != NULL) {
+            sem->prevOwned->nextOwned = sem->nextOwned;
+        }
+        else {
+            processTable3[sem->owner % MAXPROC].owned = sem->nextOwned;
+        }
+        if (sem->nextOwned != NULL) {
+            sem->nextOwned->prevOwned = sem->prevOwned;
+        }
+    }
+    sem->owner = pid;
+    sem->prevOwned = NULL;
+    sem->nextOwned = NULL;
+    if (pid > 0) {
+        PCB* proc = &processTable3[pid % MAXPROC];
+        sem->nextOwned = proc->owned;
+        if (proc->owned != NULL) {
+            proc->owned->prevOwned = sem;
+        }
+        proc->owned = sem;
+    }
+}
+
+/*
+* Adds a waiter to a semaphore's wait queue: at the tail, or for a SEM_PRIORITY
+* semaphore after the last waiter of the same or a higher priority, found in
+* at most SEM_PRIO_LEVELS steps through sem->prioTail. Must be called inside a
+* critical section.
+*
+* Parameters:
+*     sem: the semaphore to wait on
+*     w: the wait queue entry, with proc, need and priority filled in
+*/
+void semEnqueue(Semaphore* sem, SemWaiter* w) {
+    SemWaiter* after = sem->tail;
+    if (sem->flags & SEM_PRIORITY) {
+        after = NULL;
+        for (int level = w->priority - 1; level >= 0 && after == NULL; level--) {
+            after = sem->prioTail[level];
+        }
+        sem->prioTail[w->priority - 1] = w;
+    }
+
+    w->prev = after;
+    w->next = after == NULL ? sem->head : after->next;
+    w->sem = sem;
+    if (after == NULL) {
+        sem->head = w;
+    }
+    else {
+        after->next = w;
+    }
+    if (w->next == NULL) {
+        sem->tail = w;
+    }
+    else {
+        w->next->prev = w;
+    }
+    sem->numWaiters++;
+    if (sem->numWaiters > sem->stats.maxWaiters) {
+        sem->stats.maxWaiters = sem->numWaiters;
+    }
+}
+
+/*
+* Removes a waiter from anywhere in a semaphore's wait queue, so a process that
+* stops waiting early can leave without a scan. Must be called inside a critical
+* section.
+*
+* Parameters:
+*     sem: the semaphore the entry is queued on
+*     w: the wait queue entry to remove
+*/
+void semUnlink(Semaphore* sem, SemWaiter* w) {
+    if ((sem->flags & SEM_PRIORITY) && sem->prioTail[w->priority - 1] == w) {
+        int samePriority = w->prev != NULL && w->prev->priority == w->priority;
+        sem->prioTail[w->priority - 1] = samePriority ? w->prev : NULL;
+    }
+    if (w->prev == NULL) {
+        sem->head = w->next;
+    }
+    else {
+        w->prev->next = w->next;
+    }
+    if (w->next == NULL) {
+        sem->tail = w->prev;
+    }
+    else {
+        w->next->prev = w->prev;
+    }
+    w->next = NULL;
+    w->prev = NULL;
+    w->sem = NULL;
+    sem->numWaiters--;
+}
+
+/*
+* Returns the semaphore record at a table index. The index must be below
+* numberOfSems.
+*/
+Semaphore* semAt(int index) {
+    return &semChunks[index >> SEM_CHUNK_BITS][index & SEM_CHUNK_MASK];
+}
+
+/*
+* Makes sure the slot at index numberOfSems exists, allocating a new chunk when
+* every existing one is full. Must be called inside a critical section.
+*
+* Returns:
+*     1 if the slot is available, 0 if the allocation failed
+*/
+int semTableGrow() {
+    if (numberOfSems < numSemChunks * SEM_CHUNK_SIZE) {
+        return 1;
+    }
+    Semaphore* chunk = calloc(SEM_CHUNK_SIZE, sizeof(Semaphore));
+    if (chunk == NULL) {
+        return 0;
+    }
+    semChunks[numSemChunks] = chunk;
+    numSemChunks++;
+    return 1;
+}
+
+/*
+* Returns the number of bytes used by the semaphore table: the chunk directory
+* plus every chunk, static or allocated.
+*/
+int semTableBytes(void) {
+    return (int)(sizeof(semChunks) + numSemChunks * SEM_CHUNK_SIZE * sizeof(Semaphore));
+}
+
+/*
+* Prints the size and occupancy of the semaphore table to the console.
+*/
+void dumpSemTable(void) {
+    unsigned int psr = acquireLock();
+    int inUse = 0;
+    for (int i = 0; i < numberOfSems; i++) {
+        inUse += semAt(i)->inUse;
+    }
+    USLOSS_Console("Semaphore table: %d in use, %d slots used, %d chunks "
+                   "(%d allocated), %d bytes\n", inUse, numberOfSems,
+                   numSemChunks, numSemChunks - SEM_STATIC_CHUNKS,
+                   semTableBytes());
+    releaseLock(psr);
+}
+
+/*
+* Looks up the semaphore named by an id, rejecting ids that were never handed
+* out, belong to a freed semaphore, or carry a stale generation tag. Must be
+* called inside a critical section.
+*
+* Parameters:
+*     id: the semaphore id supplied by the user
+* Returns:
+*     a pointer to the semaphore, or NULL if the id is not valid
+*/
+Semaphore* semLookup(int id) {
+    if (id < 0) {
+        return NULL;
+    }
+    int index = id & SEM_INDEX_MASK;
+    if (index >= numberOfSems) {
+        return NULL;
+    }
+    Semaphore* sem = semAt(index);
+    if (!sem->inUse || sem->generation != (id >> SEM_INDEX_BITS)) {
+        return NULL;
+    }
+    return sem;
+}
+
+/*
+* Creates a semaphore with an intial value read from arg->arg1. Slots released
+* by SemFree are reused first; otherwise the next unused slot is taken, growing
+* the table by a chunk if needed.
+* 
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the initial value of the semaphore
+*     arg->arg2: SEM_PRIORITY to wake waiters in priority order rather than
+*                FIFO; SEM_INHERIT to also lend a waiter's priority to the
+*                process that last took a unit
+* Returns:
 *     arg->arg1: the id of the semaphore created
 *     arg->arg4: stores 0 if a semaphore was successfully created, -1 otherwise
 */
 void kernSemCreate(USLOSS_Sysargs* arg) {
-    acquireLock();
-    if (numberOfSems >= MAXSEMS) {
-        arg->arg4 = (void*)(long)-1;
+    unsigned int psr = acquireLock();
+    int index;
+    if (semFreeList != -1) {
+        index = semFreeList;
+        semFreeList = semAt(index)->nextFree;
     }
-    else {
-        int initialValue = (int)(long)arg->arg1;
-        semaphoresList[numberOfSems] = initialValue;
-        arg->arg1 = (void*)(long)numberOfSems;
-        arg->arg4 = (void*)(long)0;
+    else if (numberOfSems < SEM_TABLE_LIMIT && semTableGrow()) {
+        index = numberOfSems;
+        semAt(index)->generation = 0;
         numberOfSems++;
     }
-    releaseLock();
+    else {
+        arg->arg4 = (void*)(long)-1;
+        releaseLock(psr);
+        return;
+    }
+
+    Semaphore* sem = semAt(index);
+    sem->value = (int)(long)arg->arg1;
+    sem->numWaiters = 0;
+    sem->head = NULL;
+    sem->tail = NULL;
+    for (int i = 0; i < SEM_PRIO_LEVELS; i++) {
+        sem->prioTail[i] = NULL;
+    }
+    sem->flags = (int)(long)arg->arg2 & (SEM_PRIORITY | SEM_INHERIT);
+    if (sem->flags & SEM_INHERIT) {
+        sem->flags |= SEM_PRIORITY;
+    }
+    sem->owner = 0;
+    sem->nextOwned = NULL;
+    sem->prevOwned = NULL;
+    sem->stats = (SemStats){0};
+    sem->inUse = 1;
+    sem->nextFree = -1;
+    arg->arg1 = (void*)(long)((sem->generation << SEM_INDEX_BITS) | index);
+    arg->arg4 = (void*)(long)0;
+    releaseLock(psr);
 }
 
 /*
-* Decrements the semaphore specified by the id in arg->arg1, and
-* if the semaphore value is less than 0, it blocks the current 
-* process by trying to receive a message from the process' mailbox.
-* It then adds a pointer to the process to the linked list at the
-* semaphoreBlockedProc array at the semaphore id so it can be unblocked
-* later.
-* 
+* Frees the semaphore specified by the id in arg->arg1 and puts its slot on the
+* free list with a new generation tag, so the old id stops working. Any
+* processes still blocked on the semaphore are woken, and their SemP returns -1.
+*
 * Parameters:
 *     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
 *          arguments will be read and stored.
-*     arg->arg1: id of the semaphore to decrement
+*     arg->arg1: id of the semaphore to free
 * Returns:
-*     arg->arg4: 0 if a valid semaphore id was given, -1 otherwise
+*     arg->arg4: -1 if the id is not valid, 1 if processes were blocked on the
+*                semaphore, 0 otherwise
 */
-void kernSemP(USLOSS_Sysargs* arg) {
-    acquireLock();
+void kernSemFree(USLOSS_Sysargs* arg) {
+    unsigned int psr = acquireLock();
     int id = (int)(long)arg->arg1;
-    if (id < 0 || id >= MAXSEMS) {
+    Semaphore* sem = semLookup(id);
+    if (sem == NULL) {
         arg->arg4 = (void*)(long)-1;
-        releaseLock();
+        releaseLock(psr);
         return;
     }
-    arg->arg4 = (void*)(long)0;
-    
-    int pid = getpid();
-    semaphoresList[id]--;
-    if (semaphoresList[id] < 0) {
-        PCB* procList = semaphoreBlockedProc[id];
-        if (procList == NULL) {
-            semaphoreBlockedProc[id] = &processTable3[pid % MAXPROC];
+
+    SemWaiter* waiters = sem->head;
+    arg->arg4 = (void*)(long)(waiters != NULL);
+    semSetOwner(sem, 0);
+    sem->head = NULL;
+    sem->tail = NULL;
+    sem->numWaiters = 0;
+    sem->inUse = 0;
+    sem->generation = (sem->generation + 1) & SEM_GEN_MASK;
+    sem->nextFree = semFreeList;
+    semFreeList = id & SEM_INDEX_MASK;
+
+    // the queue is detached and every entry marked before anyone is woken,
+    // since a wakeup may switch to another process
+    for (SemWaiter* w = waiters; w != NULL; w = w->next) {
+        w->sem = NULL;
+        w->proc->wakeResult = -1;
+        if (w->proc->waitAny != NULL) {
+            waitAnyFire(w->proc, (int)(w - w->proc->waitAny->waiters));
+        }
+    }
+
+    // a blocked SemOp naming this semaphore can never complete either; these
+    // are taken off the list before the first wakeup too, or a process that
+    // runs in between could reuse the slot and be failed in its place
+    PCB* failed = NULL;
+    PCB** failedTail = &failed;
+    PCB** link = &semOpWaiters;
+    while (*link != NULL) {
+        PCB* proc = *link;
+        int i = 0;
+        while (i < proc->semOp->n && proc->semOp->sems[i] != sem) {
+            i++;
+        }
+        if (i < proc->semOp->n) {
+            *link = proc->nextSemOpWaiter;
+            proc->wakeResult = -1;
+            *failedTail = proc;
+            failedTail = &proc->nextSemOpWaiter;
         }
         else {
-            while (procList->nextBlockedProc != NULL) { // adds to tail of list
-                procList = procList->nextBlockedProc;
+            link = &proc->nextSemOpWaiter;
+        }
+    }
+    *failedTail = NULL;
+
+    while (waiters != NULL) {
+        SemWaiter* w = waiters;
+        waiters = w->next;
+        w->next = NULL;
+        w->prev = NULL;
+        unblockProc(w->proc->pid);
+    }
+    while (failed != NULL) {
+        PCB* proc = failed;
+        failed = proc->nextSemOpWaiter;
+        proc->nextSemOpWaiter = NULL;
+        unblockProc(proc->pid);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Hands a semaphore's value to its waiters in a single pass over the wait queue,
+* granting every waiter whose request now fits, in FIFO order. A waiter that does
+* not fit is passed over, but once it has been overtaken SEM_MAX_BYPASS times
+* the pass stops there so the units build up for it. The granted waiters are
+* taken off the queue and appended to a list for the caller to wake. Must be
+* called inside a critical section.
+*
+* Parameters:
+*     sem: the semaphore whose value was just increased
+*     tail: the link at the end of the list of granted waiters
+* Returns:
+*     the link at the new end of the list
+*/
+SemWaiter** semGrant(Semaphore* sem, SemWaiter** tail) {
+    SemWaiter* skipped = NULL; // oldest waiter passed over in this pass
+    SemWaiter* w = sem->head;
+    while (w != NULL && sem->value > 0) {
+        SemWaiter* next = w->next;
+        if (w->need <= sem->value) {
+            sem->value -= w->need;
+            semUnlink(sem, w);
+            semSetOwner(sem, w->proc->pid);
+            if (w->proc->waitAny != NULL) {
+                waitAnyFire(w->proc, (int)(w - w->proc->waitAny->waiters));
             }
-            procList->nextBlockedProc = &processTable3[pid % MAXPROC];         
+            *tail = w;
+            tail = &w->next;
+            if (skipped != NULL) {
+                skipped->bypassed++;
+            }
+        }
+        else if (w->bypassed >= SEM_MAX_BYPASS) {
+            break;
         }
-        releaseLock();
-        MboxRecv(processTable3[pid % MAXPROC].mboxNum, NULL, 0);
+        else if (skipped == NULL) {
+            skipped = w;
+        }
+        w = next;
     }
-    releaseLock();
+    *tail = NULL;
+    return tail;
 }
 
 /*
-* Increments the value of the semaphore specified by the id in arg->arg1
-* and if there are any process blocked by this semaphore, unblock the
-* process at the head of the list by sending a message to its mailbox,
-* then remove it from the list.
-* 
+* Unblocks every process on a detached list of semaphore waiters. Must be called
+* inside a critical section.
+*
+* Parameters:
+*     list: the first waiter to wake, or NULL
+*/
+void semWaiterListWake(SemWaiter* list) {
+    while (list != NULL) {
+        SemWaiter* w = list;
+        list = w->next;
+        w->next = NULL;
+        unblockProc(w->proc->pid);
+    }
+}
+
+/*
+* Hands a semaphore's value to its waiters, as semGrant() does, and leftover
+* units to blocked SemOp calls. Must be called inside a critical section.
+*
+* Parameters:
+*     sem: the semaphore whose value was just increased
+*/
+void semWake(Semaphore* sem) {
+    SemWaiter* woken = NULL;
+    semGrant(sem, &woken);
+    // wake only after the pass, since a wakeup may switch to another process
+    semWaiterListWake(woken);
+    if (sem->value > 0 && semOpWaiters != NULL) {
+        semOpRetry();
+    }
+}
+
+/*
+* Takes units from a semaphore, blocking until they are available. Shared by
+* kernSemP, kernSemPn and kernSemTimedP.
+*
+* A request is granted at once if the value covers it and nobody is waiting, or
+* if the waiter at the head cannot be satisfied yet and may still be overtaken.
+* Otherwise the process joins the tail of the wait queue and blocks in blockMe()
+* until semWake() hands it the units, the semaphore is freed, or its timeout
+* runs out.
+*
 * Parameters:
 *     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
 *          arguments will be read and stored.
 *     arg->arg1: id of the semaphore to decrement
+*     units: how many units to take
+*     ticks: clock ticks to wait before giving up; 0 never blocks and a negative
+*            value waits forever
 * Returns:
-*     arg->arg4: 0 if a valid semaphore id was given, -1 otherwise
+*     arg->arg4: 0 if the units were taken, 1 if the time ran out first, -1 if
+*                the id is not valid or the semaphore was freed while the
+*                process was blocked
 */
-void kernSemV(USLOSS_Sysargs* arg) {
-    acquireLock();
-    int id = (int)(long)arg->arg1;
-    if (id < 0 || id >= MAXSEMS) {
+void semAcquire(USLOSS_Sysargs* arg, int units, int ticks) {
+    unsigned int psr = acquireLock();
+    Semaphore* sem = semLookup((int)(long)arg->arg1);
+    if (sem == NULL) {
         arg->arg4 = (void*)(long)-1;
-        releaseLock();
+        releaseLock(psr);
         return;
     }
     arg->arg4 = (void*)(long)0;
-    semaphoresList[id]++;
-    
-    if (semaphoreBlockedProc[id] != NULL) {
-        PCB* process = semaphoreBlockedProc[id];
-        semaphoreBlockedProc[id] = semaphoreBlockedProc[id]->nextBlockedProc;
-        process->nextBlockedProc = NULL;
-        releaseLock();
-        MboxSend(process->mboxNum, NULL, 0);
-    }
-    releaseLock();
+    sem->stats.pCount++;
+
+    if (sem->value >= units &&
+        (sem->head == NULL || sem->head->bypassed < SEM_MAX_BYPASS)) {
+        if (sem->head != NULL) {
+            sem->head->bypassed++;
+        }
+        sem->value -= units;
+        semSetOwner(sem, getpid());
+        releaseLock(psr);
+        return;
+    }
+    if (ticks == 0) {
+        arg->arg4 = (void*)(long)1;
+        releaseLock(psr);
+        return;
+    }
+
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    proc->pid = getpid();
+    proc->wakeResult = 0;
+    proc->semWait.proc = proc;
+    proc->semWait.need = units;
+    proc->semWait.bypassed = 0;
+    proc->semWait.priority = procPriority(proc);
+    semEnqueue(sem, &proc->semWait);
+    semBoost(sem, proc->semWait.priority);
+    int blockStart = currentTime();
+    if (ticks > 0) {
+        proc->deadline = blockStart + ticks * TICK_US;
+        timerInsert(proc);
+    }
+    sem->stats.blocked++;
+    blockMe(BLOCKED_SEM);
+
+    timerRemove(proc);
+    if (proc->semWait.sem != NULL) {
+        // woken without being handed the units, so leave the queue ourselves
+        semUnlink(proc->semWait.sem, &proc->semWait);
+        proc->wakeResult = -1;
+    }
+    if (proc->wakeResult != -1) {
+        // a freed semaphore's slot may already belong to a new one
+        int blockedUs = currentTime() - blockStart;
+        sem->stats.totalBlockedUs += blockedUs;
+        if (blockedUs > sem->stats.maxBlockedUs) {
+            sem->stats.maxBlockedUs = blockedUs;
+        }
+    }
+    arg->arg4 = (void*)(long)proc->wakeResult;
+    releaseLock(psr);
+}
+
+/*
+* Adds units to a semaphore and wakes the waiters they satisfy. Shared by
+* kernSemV and kernSemVn.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to increment
+*     units: how many units to add
+* Returns:
+*     arg->arg4: 0 if a valid semaphore id was given, -1 otherwise
+*/
+void semRelease(USLOSS_Sysargs* arg, int units) {
+    unsigned int psr = acquireLock();
+    Semaphore* sem = semLookup((int)(long)arg->arg1);
+    if (sem == NULL) {
+        arg->arg4 = (void*)(long)-1;
+        releaseLock(psr);
+        return;
+    }
+    arg->arg4 = (void*)(long)0;
+
+    sem->stats.vCount++;
+    sem->value += units;
+    semWake(sem);
+
+    // keep only the priority lent by waiters on semaphores this process still owns
+    // a process running at its own priority has no loan to give back
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    if ((sem->flags & SEM_INHERIT) && proc->pid == getpid() &&
+        proc->priority != proc->basePriority) {
+        proc->priority = semInheritedPriority(proc);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Decrements the semaphore specified by the id in arg->arg1, blocking until a
+* unit is available. See semAcquire().
+* 
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to decrement
+* Returns:
+*     arg->arg4: 0 if a valid semaphore id was given, -1 if the id is not valid
+*                or the semaphore was freed while the process was blocked
+*/
+void kernSemP(USLOSS_Sysargs* arg) {
+    semAcquire(arg, 1, -1);
+}
+
+/*
+* Increments the semaphore specified by the id in arg->arg1. If any processes
+* are blocked on the semaphore, the unit is handed directly to the oldest one
+* that can use it, which is then woken with unblockProc().
+* 
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to increment
+* Returns:
+*     arg->arg4: 0 if a valid semaphore id was given, -1 otherwise
+*/
+void kernSemV(USLOSS_Sysargs* arg) {
+    semRelease(arg, 1);
+}
+
+/*
+* Takes arg->arg2 units from the semaphore specified by the id in arg->arg1 in
+* one step, blocking until all of them are available.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to decrement
+*     arg->arg2: number of units, at least 1
+* Returns:
+*     arg->arg4: 0 if the units were taken, -1 if the arguments were invalid or
+*                the semaphore was freed while the process was blocked
+*/
+void kernSemPn(USLOSS_Sysargs* arg) {
+    int units = (int)(long)arg->arg2;
+    if (units < 1) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+    semAcquire(arg, units, -1);
+}
+
+/*
+* Decrements the semaphore specified by the id in arg->arg1, giving up if no
+* unit becomes available within arg->arg2 clock ticks. With 0 ticks it never
+* blocks, which is how SemTryP() is built.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to decrement
+*     arg->arg2: clock ticks to wait, 0 or more
+* Returns:
+*     arg->arg4: 0 if a unit was taken, 1 if none was available in time, -1 if
+*                the arguments were invalid or the semaphore was freed while the
+*                process was blocked
+*/
+void kernSemTimedP(USLOSS_Sysargs* arg) {
+    int ticks = (int)(long)arg->arg2;
+    if (ticks < 0) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+    semAcquire(arg, 1, ticks);
+}
+
+/*
+* Adds arg->arg2 units to the semaphore specified by the id in arg->arg1 and
+* wakes, in a single pass, every waiter whose request they satisfy.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: id of the semaphore to increment
+*     arg->arg2: number of units, at least 1
+* Returns:
+*     arg->arg4: 0 if the units were added, -1 if the arguments were invalid
+*/
+void kernSemVn(USLOSS_Sysargs* arg) {
+    int units = (int)(long)arg->arg2;
+    if (units < 1) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+    semRelease(arg, units);
+}
+
+/*
+* Attempts to apply every adjustment of a SemOp, in order, as a single atomic
+* step. If any adjustment would take a semaphore below zero, the ones already
+* applied are undone and nothing changes. Waiters on the semaphores that went up
+* are not woken here; the caller does that with semOpWake(). Must be called
+* inside a critical section.
+*
+* Parameters:
+*     req: the adjustments to apply
+* Returns:
+*     1 if the adjustments were applied, 0 if the caller must wait
+*/
+int semOpTry(SemOpReq* req) {
+    int i;
+    for (i = 0; i < req->n; i++) {
+        Semaphore* sem = req->sems[i];
+        // units already promised to queued SemP callers are not available
+        if (req->deltas[i] < 0 && (sem->head != NULL || sem->value + req->deltas[i] < 0)) {
+            break;
+        }
+        sem->value += req->deltas[i];
+    }
+    if (i == req->n) {
+        return 1;
+    }
+    while (--i >= 0) {
+        req->sems[i]->value -= req->deltas[i];
+    }
+    return 0;
+}
+
+/*
+* Wakes waiters on every semaphore a completed SemOp increased. Must be called
+* inside a critical section.
+*
+* Parameters:
+*     req: the adjustments that were applied
+*/
+void semOpWake(SemOpReq* req) {
+    for (int i = 0; i < req->n; i++) {
+        if (req->deltas[i] > 0) {
+            semWake(req->sems[i]);
+        }
+    }
+}
+
+/*
+* Retries every blocked SemOp after a semaphore's value went up. A completed
+* SemOp may raise other semaphores and let an earlier one complete, so passes
+* over the list repeat until one completes nothing. Completed SemOp callers, and
+* SemP waiters granted the units they added, are only woken after the last
+* pass, since a wakeup may switch to another process. Must be called inside a
+* critical section.
+*/
+void semOpRetry() {
+    PCB* done = NULL;
+    PCB** doneTail = &done;
+    SemWaiter* woken = NULL;
+    SemWaiter** wokenTail = &woken;
+    int progress = 1;
+    while (progress) {
+        progress = 0;
+        PCB** link = &semOpWaiters;
+        while (*link != NULL) {
+            PCB* proc = *link;
+            if (!semOpTry(proc->semOp)) {
+                link = &proc->nextSemOpWaiter;
+                continue;
+            }
+            *link = proc->nextSemOpWaiter;
+            *doneTail = proc;
+            doneTail = &proc->nextSemOpWaiter;
+            // grant the units it added before proc runs and its request goes away
+            for (int i = 0; i < proc->semOp->n; i++) {
+                if (proc->semOp->deltas[i] > 0) {
+                    wokenTail = semGrant(proc->semOp->sems[i], wokenTail);
+                }
+            }
+            progress = 1;
+        }
+    }
+    *doneTail = NULL;
+
+    semWaiterListWake(woken);
+    while (done != NULL) {
+        PCB* proc = done;
+        done = proc->nextSemOpWaiter;
+        proc->nextSemOpWaiter = NULL;
+        proc->wakeResult = 0;
+        unblockProc(proc->pid);
+    }
+}
+
+/*
+* Applies a group of semaphore adjustments atomically. A negative delta takes
+* that many units from a semaphore and a positive delta adds them. If the whole
+* group cannot be applied right away, the process blocks until it can, and no
+* semaphore is changed in the meantime.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: array of semaphore ids
+*     arg->arg2: array of deltas, one per id
+*     arg->arg3: number of entries, 1 to SEMOP_MAX
+* Returns:
+*     arg->arg4: 0 if the group was applied, -1 if the arguments were invalid or
+*                a semaphore was freed while the process was blocked
+*/
+void kernSemOp(USLOSS_Sysargs* arg) {
+    int* ids = (int*)arg->arg1;
+    int* deltas = (int*)arg->arg2;
+    int n = (int)(long)arg->arg3;
+    if (ids == NULL || deltas == NULL || n < 1 || n > SEMOP_MAX) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    SemOpReq req; // lives on this stack until the operation completes
+    req.n = n;
+    unsigned int psr = acquireLock();
+    for (int i = 0; i < n; i++) {
+        req.sems[i] = semLookup(ids[i]);
+        req.deltas[i] = deltas[i];
+        if (req.sems[i] == NULL) {
+            arg->arg4 = (void*)(long)-1;
+            releaseLock(psr);
+            return;
+        }
+    }
+
+    // each semaphore taken from counts as a P in its statistics
+    for (int i = 0; i < n; i++) {
+        if (req.deltas[i] < 0) {
+            req.sems[i]->stats.pCount++;
+        }
+    }
+    if (semOpTry(&req)) {
+        semOpWake(&req);
+        arg->arg4 = (void*)(long)0;
+        releaseLock(psr);
+        return;
+    }
+
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    proc->pid = getpid();
+    proc->semOp = &req;
+    proc->nextSemOpWaiter = semOpWaiters;
+    semOpWaiters = proc;
+    for (int i = 0; i < n; i++) {
+        if (req.deltas[i] < 0) {
+            req.sems[i]->stats.blocked++;
+        }
+    }
+    int blockStart = currentTime();
+    blockMe(BLOCKED_SEM);
+
+    proc->semOp = NULL;
+    if (proc->wakeResult != -1) {
+        int blockedUs = currentTime() - blockStart;
+        for (int i = 0; i < n; i++) {
+            SemStats* stats = &req.sems[i]->stats;
+            if (req.deltas[i] < 0) {
+                stats->totalBlockedUs += blockedUs;
+                if (blockedUs > stats->maxBlockedUs) {
+                    stats->maxBlockedUs = blockedUs;
+                }
+            }
+        }
+    }
+    arg->arg4 = (void*)(long)proc->wakeResult;
+    releaseLock(psr);
+}
+
+/*
+* Appends a process to the tail of a wait queue. Must be called inside a
+* critical section.
+*
+* Parameters:
+*     q: the queue
+*     proc: the shadow PCB of the waiting process, with waitKind filled in
+*/
+void waitQueuePush(WaitQueue* q, PCB* proc) {
+    proc->nextWaiter = NULL;
+    if (q->tail == NULL) {
+        q->head = proc;
+    }
+    else {
+        q->tail->nextWaiter = proc;
+    }
+    q->tail = proc;
+}
+
+/*
+* Unblocks every process on a list linked through nextWaiter, with the given
+* result. The list must already be detached from any queue, since a wakeup may
+* switch to another process. Must be called inside a critical section.
+*
+* Parameters:
+*     list: the first process to wake, or NULL
+*     result: the value for each process's wakeResult
+*/
+void waitListWake(PCB* list, int result) {
+    while (list != NULL) {
+        PCB* proc = list;
+        list = proc->nextWaiter;
+        proc->nextWaiter = NULL;
+        proc->wakeResult = result;
+        unblockProc(proc->pid);
+    }
+}
+
+/*
+* Returns the RWLock with the given id, or NULL if the id does not name one in
+* use. Must be called inside a critical section.
+*/
+RWLock* rwLookup(int id) {
+    if (id < 0 || id >= MAXRWLOCKS || !rwLocks[id].inUse) {
+        return NULL;
+    }
+    return &rwLocks[id];
+}
+
+/*
+* Hands a free or read-held RWLock to the processes waiting for it, in a single
+* pass over the queue. Every waiting reader is admitted at once, unless the lock
+* prefers writers and one is waiting; otherwise the oldest writer is admitted
+* once no reader holds the lock. Must be called inside a critical section.
+*
+* Parameters:
+*     rw: the lock that was just released
+*/
+void rwAdmit(RWLock* rw) {
+    if (rw->writer != 0) {
+        return;
+    }
+    int admitReaders = rw->waitingReaders > 0 &&
+        (!(rw->flags & RWLOCK_WRITER_PREF) || rw->waitingWriters == 0);
+    int admitWriter = !admitReaders && rw->readers == 0 && rw->waitingWriters > 0;
+    if (!admitReaders && !admitWriter) {
+        return;
+    }
+
+    // take the admitted waiters out and put the rest back in order
+    PCB* list = rw->waiters.head;
+    rw->waiters.head = NULL;
+    rw->waiters.tail = NULL;
+    PCB* woken = NULL;
+    PCB** wokenTail = &woken;
+    while (list != NULL) {
+        PCB* proc = list;
+        list = proc->nextWaiter;
+        int isWriter = proc->waitKind == RWLOCK_OP_WRITELOCK;
+        if (admitReaders && !isWriter) {
+            rw->readers++;
+            rw->waitingReaders--;
+            proc->readHolds[rw - rwLocks]++;
+        }
+        else if (admitWriter && isWriter) {
+            rw->writer = proc->pid;
+            rw->waitingWriters--;
+            admitWriter = 0;
+        }
+        else {
+            waitQueuePush(&rw->waiters, proc);
+            continue;
+        }
+        *wokenTail = proc;
+        wokenTail = &proc->nextWaiter;
+    }
+    *wokenTail = NULL;
+    waitListWake(woken, 0);
+}
+
+/*
+* Reader-writer lock system call. Many processes may hold the lock for reading
+* at once, or one for writing. A reader does not wait for queued writers unless
+* the lock was created with RWLOCK_WRITER_PREF, which keeps a steady stream of
+* readers from starving writers.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the operation, one of RWLOCK_OP_*
+*     arg->arg2: flags for RWLOCK_OP_CREATE; the lock id otherwise
+* Returns:
+*     arg->arg1: the id of the lock created, for RWLOCK_OP_CREATE
+*     arg->arg4: 0 on success, or for RWLOCK_OP_FREE 1 if processes were
+*                blocked on the lock; -1 if the id or operation is not valid,
+*                the caller does not hold the lock it is unlocking, no lock is
+*                free, or the lock was freed while the process was blocked
+*/
+void kernRWLock(USLOSS_Sysargs* arg) {
+    int op = (int)(long)arg->arg1;
+    int id = (int)(long)arg->arg2;
+    unsigned int psr = acquireLock();
+    arg->arg4 = (void*)(long)-1;
+
+    if (op == RWLOCK_OP_CREATE) {
+        for (int i = 0; i < MAXRWLOCKS; i++) {
+            if (!rwLocks[i].inUse) {
+                rwLocks[i].inUse = 1;
+                rwLocks[i].flags = id & RWLOCK_WRITER_PREF;
+                rwLocks[i].readers = 0;
+                rwLocks[i].writer = 0;
+                rwLocks[i].waitingReaders = 0;
+                rwLocks[i].waitingWriters = 0;
+                rwLocks[i].waiters.head = NULL;
+                rwLocks[i].waiters.tail = NULL;
+                // holds left on a freed lock with this id do not carry over
+                for (int j = 0; j < MAXPROC; j++) {
+                    processTable3[j].readHolds[i] = 0;
+                }
+                arg->arg1 = (void*)(long)i;
+                arg->arg4 = (void*)(long)0;
+                break;
+            }
+        }
+        releaseLock(psr);
+        return;
+    }
+
+    RWLock* rw = rwLookup(id);
+    if (rw == NULL) {
+        releaseLock(psr);
+        return;
+    }
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    proc->pid = getpid();
+
+    switch (op) {
+    case RWLOCK_OP_READLOCK:
+        if (rw->writer == 0 &&
+            (!(rw->flags & RWLOCK_WRITER_PREF) || rw->waitingWriters == 0)) {
+            rw->readers++;
+            proc->readHolds[id]++;
+            arg->arg4 = (void*)(long)0;
+            break;
+        }
+        proc->waitKind = op;
+        rw->waitingReaders++;
+        waitQueuePush(&rw->waiters, proc);
+        blockMe(BLOCKED_SYNC);
+        arg->arg4 = (void*)(long)proc->wakeResult;
+        break;
+
+    case RWLOCK_OP_WRITELOCK:
+        if (rw->writer == 0 && rw->readers == 0) {
+            rw->writer = proc->pid;
+            arg->arg4 = (void*)(long)0;
+            break;
+        }
+        proc->waitKind = op;
+        rw->waitingWriters++;
+        waitQueuePush(&rw->waiters, proc);
+        blockMe(BLOCKED_SYNC);
+        arg->arg4 = (void*)(long)proc->wakeResult;
+        break;
+
+    case RWLOCK_OP_READUNLOCK:
+        if (proc->readHolds[id] > 0) {
+            proc->readHolds[id]--;
+            rw->readers--;
+            rwAdmit(rw);
+            arg->arg4 = (void*)(long)0;
+        }
+        break;
+
+    case RWLOCK_OP_WRITEUNLOCK:
+        if (rw->writer == proc->pid) {
+            rw->writer = 0;
+            rwAdmit(rw);
+            arg->arg4 = (void*)(long)0;
+        }
+        break;
+
+    case RWLOCK_OP_FREE: {
+        PCB* waiters = rw->waiters.head;
+        rw->inUse = 0;
+        rw->waiters.head = NULL;
+        rw->waiters.tail = NULL;
+        arg->arg4 = (void*)(long)(waiters != NULL);
+        waitListWake(waiters, -1);
+        break;
+    }
+    }
+    releaseLock(psr);
+}
+
+/*
+* Wakes every process on a detached list of condition variable waiters with the
+* given result. One that has not blocked yet is only marked, so it skips
+* blocking. Must be called inside a critical section.
+*
+* Parameters:
+*     list: the first process to wake, or NULL
+*     result: the value for each process's wakeResult
+*/
+void condWake(PCB* list, int result) {
+    while (list != NULL) {
+        PCB* proc = list;
+        list = proc->nextWaiter;
+        proc->nextWaiter = NULL;
+        proc->wakeResult = result;
+        if (proc->waitKind == COND_BLOCKED) {
+            unblockProc(proc->pid);
+        }
+        else {
+            proc->waitKind = COND_SIGNALED;
+        }
+    }
+}
+
+/*
+* Condition variable system call. CondWait releases a semaphore used as a mutex
+* and joins the condition's queue as one step, then takes the semaphore again
+* once signaled. CondBroadcast detaches the whole queue and wakes it in one pass.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the operation, one of COND_OP_*
+*     arg->arg2: the condition variable id, except for COND_OP_CREATE
+*     arg->arg3: for COND_OP_WAIT, the id of the semaphore to release
+* Returns:
+*     arg->arg1: the id of the condition variable created, for COND_OP_CREATE
+*     arg->arg4: 0 on success, or for COND_OP_FREE 1 if processes were waiting;
+*                -1 if an id or the operation is not valid, no condition
+*                variable is free, or it was freed while the process waited
+*/
+void kernCond(USLOSS_Sysargs* arg) {
+    int op = (int)(long)arg->arg1;
+    int id = (int)(long)arg->arg2;
+    unsigned int psr = acquireLock();
+    arg->arg4 = (void*)(long)-1;
+
+    if (op == COND_OP_CREATE) {
+        for (int i = 0; i < MAXCONDS; i++) {
+            if (!condVars[i].inUse) {
+                condVars[i].inUse = 1;
+                condVars[i].waiters.head = NULL;
+                condVars[i].waiters.tail = NULL;
+                arg->arg1 = (void*)(long)i;
+                arg->arg4 = (void*)(long)0;
+                break;
+            }
+        }
+        releaseLock(psr);
+        return;
+    }
+
+    if (id < 0 || id >= MAXCONDS || !condVars[id].inUse) {
+        releaseLock(psr);
+        return;
+    }
+    CondVar* cv = &condVars[id];
+
+    switch (op) {
+    case COND_OP_WAIT: {
+        int semId = (int)(long)arg->arg3;
+        if (semLookup(semId) == NULL) {
+            break;
+        }
+        PCB* proc = &processTable3[getpid() % MAXPROC];
+        proc->pid = getpid();
+        proc->waitKind = COND_WAITING;
+        waitQueuePush(&cv->waiters, proc);
+        arg->arg1 = (void*)(long)semId;
+        semRelease(arg, 1);
+        if (proc->waitKind == COND_WAITING) {
+            proc->waitKind = COND_BLOCKED;
+            blockMe(BLOCKED_SYNC);
+        }
+        int result = proc->wakeResult;
+        releaseLock(psr);
+
+        semAcquire(arg, 1, -1); // arg->arg1 still holds the semaphore id
+        if (result != 0) {
+            arg->arg4 = (void*)(long)result;
+        }
+        return;
+    }
+
+    case COND_OP_SIGNAL: {
+        PCB* proc = cv->waiters.head;
+        if (proc != NULL) {
+            cv->waiters.head = proc->nextWaiter;
+            if (cv->waiters.head == NULL) {
+                cv->waiters.tail = NULL;
+            }
+            proc->nextWaiter = NULL;
+            condWake(proc, 0);
+        }
+        arg->arg4 = (void*)(long)0;
+        break;
+    }
+
+    case COND_OP_BROADCAST:
+    case COND_OP_FREE: {
+        PCB* waiters = cv->waiters.head;
+        cv->waiters.head = NULL;
+        cv->waiters.tail = NULL;
+        if (op == COND_OP_FREE) {
+            cv->inUse = 0;
+            arg->arg4 = (void*)(long)(waiters != NULL);
+        }
+        else {
+            arg->arg4 = (void*)(long)0;
+        }
+        condWake(waiters, op == COND_OP_FREE ? -1 : 0);
+        break;
+    }
+    }
+    releaseLock(psr);
+}
+
+/*
+* Barrier system call. Each BarrierWait blocks until the barrier's number of
+* processes have arrived. The last to arrive releases the whole generation in one
+* pass and the barrier starts over, ready for the next round.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the operation, one of BARRIER_OP_*
+*     arg->arg2: for BARRIER_OP_CREATE, the number of processes, at least 1;
+*                the barrier id otherwise
+* Returns:
+*     arg->arg1: the id of the barrier created, for BARRIER_OP_CREATE
+*     arg->arg4: 0 on success, or 1 for the process whose BARRIER_OP_WAIT
+*                released the barrier, or for BARRIER_OP_FREE if processes were
+*                waiting; -1 if an argument is not valid, no barrier is free,
+*                or the barrier was freed while the process waited
+*/
+void kernBarrier(USLOSS_Sysargs* arg) {
+    int op = (int)(long)arg->arg1;
+    int id = (int)(long)arg->arg2;
+    unsigned int psr = acquireLock();
+    arg->arg4 = (void*)(long)-1;
+
+    if (op == BARRIER_OP_CREATE) {
+        for (int i = 0; id >= 1 && i < MAXBARRIERS; i++) {
+            if (!barriers[i].inUse) {
+                barriers[i].inUse = 1;
+                barriers[i].parties = id;
+                barriers[i].arrived = 0;
+                barriers[i].generation = 0;
+                barriers[i].waiters.head = NULL;
+                barriers[i].waiters.tail = NULL;
+                arg->arg1 = (void*)(long)i;
+                arg->arg4 = (void*)(long)0;
+                break;
+            }
+        }
+        releaseLock(psr);
+        return;
+    }
+
+    if (id < 0 || id >= MAXBARRIERS || !barriers[id].inUse) {
+        releaseLock(psr);
+        return;
+    }
+    Barrier* b = &barriers[id];
+
+    if (op == BARRIER_OP_WAIT) {
+        if (++b->arrived == b->parties) {
+            PCB* waiters = b->waiters.head;
+            b->waiters.head = NULL;
+            b->waiters.tail = NULL;
+            b->arrived = 0;
+            b->generation++;
+            arg->arg4 = (void*)(long)1;
+            waitListWake(waiters, 0);
+        }
+        else {
+            PCB* proc = &processTable3[getpid() % MAXPROC];
+            proc->pid = getpid();
+            waitQueuePush(&b->waiters, proc);
+            blockMe(BLOCKED_SYNC);
+            arg->arg4 = (void*)(long)proc->wakeResult;
+        }
+    }
+    else if (op == BARRIER_OP_FREE) {
+        PCB* waiters = b->waiters.head;
+        b->inUse = 0;
+        b->waiters.head = NULL;
+        b->waiters.tail = NULL;
+        arg->arg4 = (void*)(long)(waiters != NULL);
+        waitListWake(waiters, -1);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Returns whether an event flag group's bits satisfy a waiter.
+*
+* Parameters:
+*     bits: the bits currently set
+*     mask: the bits waited for
+*     mode: FLAGS_ANY or FLAGS_ALL
+*/
+int flagsMet(unsigned int bits, unsigned int mask, int mode) {
+    return mode == FLAGS_ALL ? (bits & mask) == mask : (bits & mask) != 0;
+}
+
+/*
+* Event flag system call. A group holds 32 bits; a process can wait until any or
+* all of a mask of them are set. Setting bits makes one pass over the waiters and
+* wakes only those whose condition now holds. Waiting does not clear any bits.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the operation, one of FLAGS_OP_*
+*     arg->arg2: the group id, except for FLAGS_OP_CREATE
+*     arg->arg3: the mask of bits to set, clear or wait for
+*     arg->arg5: for FLAGS_OP_WAIT, FLAGS_ANY or FLAGS_ALL
+* Returns:
+*     arg->arg1: the id of the group created, for FLAGS_OP_CREATE
+*     arg->arg2: the bits set when the wait ended, for FLAGS_OP_WAIT
+*     arg->arg4: 0 on success, or for FLAGS_OP_FREE 1 if processes were
+*                waiting; -1 if an argument is not valid, no group is free, or
+*                the group was freed while the process waited
+*/
+void kernFlags(USLOSS_Sysargs* arg) {
+    int op = (int)(long)arg->arg1;
+    int id = (int)(long)arg->arg2;
+    unsigned int mask = (unsigned int)(long)arg->arg3;
+    int mode = (int)(long)arg->arg5;
+    unsigned int psr = acquireLock();
+    arg->arg4 = (void*)(long)-1;
+
+    if (op == FLAGS_OP_CREATE) {
+        for (int i = 0; i < MAXFLAGGROUPS; i++) {
+            if (!flagGroups[i].inUse) {
+                flagGroups[i].inUse = 1;
+                flagGroups[i].bits = 0;
+                flagGroups[i].waiters.head = NULL;
+                flagGroups[i].waiters.tail = NULL;
+                arg->arg1 = (void*)(long)i;
+                arg->arg4 = (void*)(long)0;
+                break;
+            }
+        }
+        releaseLock(psr);
+        return;
+    }
+
+    if (id < 0 || id >= MAXFLAGGROUPS || !flagGroups[id].inUse) {
+        releaseLock(psr);
+        return;
+    }
+    FlagGroup* group = &flagGroups[id];
+
+    switch (op) {
+    case FLAGS_OP_SET: {
+        group->bits |= mask;
+        // take the satisfied waiters out and put the rest back in order
+        PCB* list = group->waiters.head;
+        group->waiters.head = NULL;
+        group->waiters.tail = NULL;
+        PCB* woken = NULL;
+        PCB** wokenTail = &woken;
+        while (list != NULL) {
+            PCB* proc = list;
+            list = proc->nextWaiter;
+            if (flagsMet(group->bits, proc->waitMask, proc->waitKind)) {
+                proc->waitMask = group->bits;
+                *wokenTail = proc;
+                wokenTail = &proc->nextWaiter;
+            }
+            else {
+                waitQueuePush(&group->waiters, proc);
+            }
+        }
+        *wokenTail = NULL;
+        arg->arg4 = (void*)(long)0;
+        waitListWake(woken, 0);
+        break;
+    }
+
+    case FLAGS_OP_CLEAR:
+        group->bits &= ~mask;
+        arg->arg4 = (void*)(long)0;
+        break;
+
+    case FLAGS_OP_WAIT:
+        if (mask == 0 || (mode != FLAGS_ANY && mode != FLAGS_ALL)) {
+            break;
+        }
+        if (flagsMet(group->bits, mask, mode)) {
+            arg->arg2 = (void*)(long)group->bits;
+            arg->arg4 = (void*)(long)0;
+        }
+        else {
+            PCB* proc = &processTable3[getpid() % MAXPROC];
+            proc->pid = getpid();
+            proc->waitKind = mode;
+            proc->waitMask = mask;
+            waitQueuePush(&group->waiters, proc);
+            blockMe(BLOCKED_SYNC);
+            arg->arg2 = (void*)(long)proc->waitMask;
+            arg->arg4 = (void*)(long)proc->wakeResult;
+        }
+        break;
+
+    case FLAGS_OP_FREE: {
+        PCB* waiters = group->waiters.head;
+        group->inUse = 0;
+        group->waiters.head = NULL;
+        group->waiters.tail = NULL;
+        for (PCB* proc = waiters; proc != NULL; proc = proc->nextWaiter) {
+            proc->waitMask = group->bits;
+        }
+        arg->arg4 = (void*)(long)(waiters != NULL);
+        waitListWake(waiters, -1);
+        break;
+    }
+    }
+    releaseLock(psr);
+}
+
+/*
+* Statistics system call, for reading the kernel's instrumentation at run time.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the operation, one of STATS_OP_*
+*     arg->arg2: STATS_OP_SYSCALL: the syscall number
+*                STATS_OP_TRACE: the most records to copy
+*                STATS_OP_LOCK: the syscall number, or -1 for outside any
+*                STATS_OP_SEM: the semaphore id
+*     arg->arg3: where to copy the SyscallStats, TraceRecords, LockStats or
+*                SemStats
+* Returns:
+*     arg->arg1: for STATS_OP_TRACE, the number of records copied, oldest first
+*     arg->arg4: 0 on success, -1 if an argument is not valid
+*/
+void kernStats(USLOSS_Sysargs* arg) {
+    int op = (int)(long)arg->arg1;
+    int n = (int)(long)arg->arg2;
+    unsigned int psr = acquireLock();
+    arg->arg4 = (void*)(long)-1;
+
+    if (arg->arg3 == NULL) {
+        // nothing to copy into
+    }
+    else if (op == STATS_OP_SYSCALL && n >= 0 && n < MAXSYSCALLS) {
+        *(SyscallStats*)arg->arg3 = syscallStats[n];
+        arg->arg4 = (void*)(long)0;
+    }
+    else if (op == STATS_OP_SEM && semLookup(n) != NULL) {
+        *(SemStats*)arg->arg3 = semLookup(n)->stats;
+        arg->arg4 = (void*)(long)0;
+    }
+    else if (op == STATS_OP_LOCK && n >= -1 && n < MAXSYSCALLS) {
+        *(LockStats*)arg->arg3 = lockStats[n == -1 ? MAXSYSCALLS : n];
+        arg->arg4 = (void*)(long)0;
+    }
+    else if (op == STATS_OP_TRACE && n >= 0) {
+        TraceRecord* out = (TraceRecord*)arg->arg3;
+        int kept = traceCount < TRACE_RING_SIZE ? traceCount : TRACE_RING_SIZE;
+        int count = n < kept ? n : kept;
+        for (int i = 0; i < count; i++) {
+            out[i] = traceRing[(traceCount - count + i) % TRACE_RING_SIZE];
+        }
+        arg->arg1 = (void*)(long)count;
+        arg->arg4 = (void*)(long)0;
+    }
+    releaseLock(psr);
+}
+
+/*
+* Prints the counters and latency histogram of every syscall that has completed,
+* followed by the trace ring, oldest record first.
+*/
+void dumpSyscallStats(void) {
+    unsigned int psr = acquireLock();
+    USLOSS_Console("Syscall statistics (latencies in us):\n");
+    for (int n = 0; n < MAXSYSCALLS; n++) {
+        SyscallStats* stats = &syscallStats[n];
+        if (stats->calls == 0) {
+            continue;
+        }
+        USLOSS_Console("  syscall %2d: %6d calls, avg %6d, max %7d |", n,
+                       stats->calls, stats->totalUs / stats->calls, stats->maxUs);
+        for (int b = 0; b < TRACE_BUCKETS; b++) {
+            if (stats->histogram[b] != 0) {
+                USLOSS_Console(" <%d:%d", 1 << b, stats->histogram[b]);
+            }
+        }
+        USLOSS_Console("\n");
+    }
+
+    int kept = traceCount < TRACE_RING_SIZE ? traceCount : TRACE_RING_SIZE;
+    USLOSS_Console("Last %d syscalls:\n", kept);
+    for (int i = traceCount - kept; i < traceCount; i++) {
+        TraceRecord* rec = &traceRing[i % TRACE_RING_SIZE];
+        USLOSS_Console("  at %9d pid %2d syscall %2d (%p, %p, %p, %p, %p) %d us\n",
+                       rec->start, rec->pid, rec->number, rec->args[0], rec->args[1],
+                       rec->args[2], rec->args[3], rec->args[4], rec->duration);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Prints the kernel lock statistics of every syscall handler that took the lock,
+* busiest first by total hold time, then those for code outside any syscall.
+*/
+void dumpLockStats(void) {
+    unsigned int psr = acquireLock();
+    int order[MAXSYSCALLS];
+    int count = 0;
+    for (int n = 0; n < MAXSYSCALLS; n++) {
+        if (lockStats[n].acquisitions == 0) {
+            continue;
+        }
+        // insertion sort on total hold time; there are at most MAXSYSCALLS
+        int i = count++;
+        while (i > 0 && lockStats[order[i - 1]].totalHoldUs < lockStats[n].totalHoldUs) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = n;
+    }
+
+    USLOSS_Console("Kernel lock by syscall (hold times in us of CPU):\n");
+    for (int i = 0; i <= count; i++) {
+        int n = i < count ? order[i] : MAXSYSCALLS;
+        LockStats* stats = &lockStats[n];
+        if (n == MAXSYSCALLS) {
+            USLOSS_Console("  no syscall:");
+        }
+        else {
+            USLOSS_Console("  syscall %2d:", n);
+        }
+        USLOSS_Console(" %7d acquired, %6d nested, hold total %8d, max %6d\n",
+                       stats->acquisitions, stats->nested, stats->totalHoldUs,
+                       stats->maxHoldUs);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Returns whether semaphore a was a worse bottleneck than semaphore b: more total
+* time blocked on it, or as much and more blocked P calls.
+*/
+int semHotter(Semaphore* a, Semaphore* b) {
+    if (a->stats.totalBlockedUs != b->stats.totalBlockedUs) {
+        return a->stats.totalBlockedUs > b->stats.totalBlockedUs;
+    }
+    return a->stats.blocked > b->stats.blocked;
+}
+
+/*
+* Prints the statistics of the SEM_HOT_COUNT semaphores whose waiters spent the
+* most time blocked. Freed semaphores are included until their slot is reused.
+*/
+void dumpSemStats(void) {
+    unsigned int psr = acquireLock();
+    int hot[SEM_HOT_COUNT];
+    int count = 0;
+    for (int i = 0; i < numberOfSems; i++) {
+        Semaphore* sem = semAt(i);
+        if (sem->stats.pCount == 0 && sem->stats.vCount == 0) {
+            continue;
+        }
+        // keep hot[] sorted, hottest first, dropping the coolest when full
+        int j = count < SEM_HOT_COUNT ? count++ : SEM_HOT_COUNT;
+        while (j > 0 && semHotter(sem, semAt(hot[j - 1]))) {
+            if (j < SEM_HOT_COUNT) {
+                hot[j] = hot[j - 1];
+            }
+            j--;
+        }
+        if (j < SEM_HOT_COUNT) {
+            hot[j] = i;
+        }
+    }
+
+    USLOSS_Console("Hottest semaphores (blocked times in us):\n");
+    for (int i = 0; i < count; i++) {
+        Semaphore* sem = semAt(hot[i]);
+        // SemFree moved a freed semaphore's slot on to the next generation
+        int generation = sem->inUse ? sem->generation : (sem->generation - 1) & SEM_GEN_MASK;
+        int id = (generation << SEM_INDEX_BITS) | hot[i];
+        USLOSS_Console("  sem %6d%s: %6d P, %6d V, %6d blocked, %3d max waiters, "
+                       "blocked total %8d, max %7d\n", id, sem->inUse ? "" : " (freed)",
+                       sem->stats.pCount, sem->stats.vCount, sem->stats.blocked,
+                       sem->stats.maxWaiters, sem->stats.totalBlockedUs,
+                       sem->stats.maxBlockedUs);
+    }
+    releaseLock(psr);
+}
+
+/*
+* Returns the head of the futex bucket list for an address. The low bits are
+* dropped since futex words are ints.
+*/
+PCB** futexBucket(int* addr) {
+    unsigned long key = (unsigned long)addr >> 2;
+    return &futexBuckets[(key ^ (key >> 6)) & (FUTEX_BUCKETS - 1)];
+}
+
+/*
+* Blocks the current process on a user address, but only if the int there still
+* holds the expected value; the check and the block happen in one critical
+* section, so a FutexWake that follows a change to the word cannot be missed.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the address to wait on
+*     arg->arg2: the value the caller last saw there
+* Returns:
+*     arg->arg4: 0 if woken by FutexWake, 1 if the value had already changed,
+*                -1 if the address is NULL
+*/
+void kernFutexWait(USLOSS_Sysargs* arg) {
+    int* addr = (int*)arg->arg1;
+    int expected = (int)(long)arg->arg2;
+    if (addr == NULL) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    unsigned int psr = acquireLock();
+    if (*addr != expected) {
+        arg->arg4 = (void*)(long)1;
+        releaseLock(psr);
+        return;
+    }
+
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    proc->pid = getpid();
+    proc->futexAddr = addr;
+    proc->nextFutexWaiter = NULL;
+    PCB** link = futexBucket(addr);
+    while (*link != NULL) { // append, so waiters on one address wake in order
+        link = &(*link)->nextFutexWaiter;
+    }
+    *link = proc;
+    blockMe(BLOCKED_FUTEX);
+
+    arg->arg4 = (void*)(long)0;
+    releaseLock(psr);
+}
+
+/*
+* Wakes up to arg->arg2 processes blocked in FutexWait on the address in
+* arg->arg1, oldest first.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: the address to wake waiters on
+*     arg->arg2: the most processes to wake
+* Returns:
+*     arg->arg1: the number of processes woken
+*     arg->arg4: 0, or -1 if the address is NULL
+*/
+void kernFutexWake(USLOSS_Sysargs* arg) {
+    int* addr = (int*)arg->arg1;
+    int max = (int)(long)arg->arg2;
+    if (addr == NULL) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    unsigned int psr = acquireLock();
+    PCB* woken[MAXPROC];
+    int numWoken = 0;
+    PCB** link = futexBucket(addr);
+    while (*link != NULL && numWoken < max) {
+        PCB* proc = *link;
+        if (proc->futexAddr == addr) {
+            *link = proc->nextFutexWaiter;
+            proc->futexAddr = NULL;
+            woken[numWoken++] = proc;
+        }
+        else {
+            link = &proc->nextFutexWaiter;
+        }
+    }
+    // wake only after the bucket is updated, since a wakeup may switch away
+    for (int i = 0; i < numWoken; i++) {
+        unblockProc(woken[i]->pid);
+    }
+
+    arg->arg1 = (void*)(long)numWoken;
+    arg->arg4 = (void*)(long)0;
+    releaseLock(psr);
+}
+
+/*
+* Returns whether a syscall can run in a non-blocking batch: it never blocks the
+* caller. Anything not listed here is assumed to block, so syscalls added later
+* stop such a batch until they are added.
+*/
+int batchNeverBlocks(int number) {
+    switch (number) {
+    case SYS_SEMCREATE:
+    case SYS_SEMV:
+    case SYS_SEMVN:
+    case SYS_SEMFREE:
+    case SYS_FUTEXWAKE:
+    case SYS_GETPID:
+    case SYS_GETTIMEOFDAY:
+    case SYS_GETPROCINFO:
+    case SYS_SPAWN:
+    case SYS_SPAWNMANY:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+* Runs a batch of syscalls, in order, inside a single trap. Each entry is a
+* USLOSS_Sysargs filled in exactly as for its own syscall, and its results are
+* written back into it by the normal handler.
+*
+* Without BATCH_MAY_BLOCK the batch stops at the first entry that could block:
+* SemP, SemPn and SemPTimeout are tried without waiting, and if no units are
+* available that entry's arg4 is set to 1 and nothing more runs. Calls known
+* never to block (see batchNeverBlocks()) run normally; any other call stops
+* the batch before it runs. With BATCH_MAY_BLOCK every entry runs normally and
+* the process may block partway through, resuming with the next entry.
+*
+* Each entry that runs is traced and profiled as its own syscall, as well as
+* being part of the batch's own record.
+*
+* Parameters:
+*     arg: a pointer to a USLOSS_Sysargs struct where the syscall out
+*          arguments will be read and stored.
+*     arg->arg1: array of entries
+*     arg->arg2: number of entries, 1 to BATCH_MAX
+*     arg->arg3: BATCH_MAY_BLOCK, or 0
+* Returns:
+*     arg->arg1: number of entries that ran to completion
+*     arg->arg4: 0 if every entry ran, 1 if the batch stopped at an entry that
+*                would block, -1 if the batch or the entry it stopped at was
+*                invalid (Terminate and nested batches are not allowed)
+*/
+void kernBatch(USLOSS_Sysargs* arg) {
+    USLOSS_Sysargs* entries = (USLOSS_Sysargs*)arg->arg1;
+    int n = (int)(long)arg->arg2;
+    int mayBlock = ((int)(long)arg->arg3 & BATCH_MAY_BLOCK) != 0;
+    arg->arg1 = (void*)(long)0;
+    if (entries == NULL || n < 1 || n > BATCH_MAX) {
+        arg->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    PCB* proc = &processTable3[getpid() % MAXPROC];
+    int result = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        USLOSS_Sysargs* entry = &entries[i];
+        int number = entry->number;
+        if (number < 0 || number >= MAXSYSCALLS || systemCallVec[number] == NULL ||
+            number == SYS_TERMINATE || number == SYS_BATCH) {
+            result = -1;
+            break;
+        }
+        int tryP = !mayBlock &&
+            (number == SYS_SEMP || number == SYS_SEMPN || number == SYS_SEMTIMEDP);
+        if (!mayBlock && !tryP && !batchNeverBlocks(number)) {
+            result = 1;
+            break;
+        }
+
+        TraceRecord rec;
+        traceStart(&rec, entry);
+        proc->syscall = number;
+        if (tryP) {
+            int units = number == SYS_SEMPN ? (int)(long)entry->arg2 : 1;
+            if (units < 1) {
+                entry->arg4 = (void*)(long)-1;
+            }
+            else {
+                semAcquire(entry, units, 0);
+            }
+        }
+        else {
+            systemCallVec[number](entry);
+        }
+        rec.duration = currentTime() - rec.start;
+        proc->syscall = -1;
+        unsigned int psr = acquireLock();
+        traceSyscall(&rec);
+        releaseLock(psr);
+        proc->syscall = SYS_BATCH;
+
+        if (tryP && (long)entry->arg4 == 1) {
+            result = 1;
+            break;
+        }
+    }
+
+    arg->arg1 = (void*)(long)i;
+    arg->arg4 = (void*)(long)result;
 }
 
 /*
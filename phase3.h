@@ -5,9 +5,22 @@
 #ifndef _PHASE3_H
 #define _PHASE3_H
 
+// MAXSEMS semaphores are always available; past that the table grows on
+// demand, up to SEM_TABLE_LIMIT semaphores in existence at once
 #define MAXSEMS         200
+#define SEM_TABLE_LIMIT 65536
+
+#define MAXRWLOCKS      50
+#define MAXCONDS        50
+#define MAXBARRIERS     50
+#define MAXFLAGGROUPS   50
 
 extern void phase3_init(void);
+extern int  semTableBytes(void);
+extern void dumpSemTable(void);
+extern void dumpSyscallStats(void);
+extern void dumpLockStats(void);
+extern void dumpSemStats(void);
 
 #endif /* _PHASE3_H */
 
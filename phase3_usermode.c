@@ -45,6 +45,36 @@ int Spawn(char *name, int (*func)(char*), char *arg, int stack_size,
 
 
 
+/* returns 0 if all n children were created, 1 if only some were (pids[] holds
+ * -1 for the rest), -1 on error; *created is set to the number created
+ */
+int SpawnMany(char *name_prefix, int (*func)(char*), char **args, int n,
+              int stack_size, int priority, int *pids, int *created)
+{
+    require_user_mode(__func__);
+
+    SpawnManyReq req;
+    req.namePrefix = name_prefix;
+    req.func       = func;
+    req.args       = args;
+    req.n          = n;
+    req.stackSize  = stack_size;
+    req.priority   = priority;
+    req.pids       = pids;
+
+    USLOSS_Sysargs sysargs;
+    memset(&sysargs, 0, sizeof(sysargs));
+
+    sysargs.number = SYS_SPAWNMANY;
+    sysargs.arg1   = &req;
+    USLOSS_Syscall(&sysargs);
+
+    *created = (int)(long)sysargs.arg1;
+    return     (int)(long)sysargs.arg4;
+}
+
+
+
 int Wait(int *pid, int *status)
 {
     require_user_mode(__func__);
@@ -62,6 +92,102 @@ int Wait(int *pid, int *status)
 
 
 
+/* helper function for the Wait variants; see kernWaitChild() */
+static int wait_child(int want, int ticks, int *pid, int *status)
+{
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_WAITCHILD;
+    args.arg1   = (void*)(long)want;
+    args.arg2   = (void*)(long)ticks;
+    USLOSS_Syscall(&args);
+
+    *status = (int)(long)args.arg2;
+    *pid    = (int)(long)args.arg1;
+    return    (int)(long)args.arg4;
+}
+
+
+
+int WaitPid(int pid, int *status)
+{
+    require_user_mode(__func__);
+
+    int found;
+    return wait_child(pid, -1, &found, status);
+}
+
+
+
+int WaitNoHang(int *pid, int *status)
+{
+    require_user_mode(__func__);
+
+    return wait_child(-1, 0, pid, status);
+}
+
+
+
+/* returns -1 for negative ticks, as SemPTimeout() does, rather than waiting
+ * forever; use Wait() or WaitPid(-1) for that
+ */
+int WaitTimeout(int *pid, int *status, int ticks)
+{
+    require_user_mode(__func__);
+
+    if (ticks < 0)
+        return -1;
+    return wait_child(-1, ticks, pid, status);
+}
+
+
+
+/* returns the number of children reaped, or -2 if there are none */
+int WaitMany(int *pids, int *statuses, int max)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_WAITMANY;
+    args.arg1   = pids;
+    args.arg2   = statuses;
+    args.arg3   = (void*)(long)max;
+    USLOSS_Syscall(&args);
+
+    int rc = (int)(long)args.arg4;
+    if (rc != 0)
+        return rc;
+    return (int)(long)args.arg1;
+}
+
+
+
+/* which is set to the index of the semaphore taken, or -1 if a child terminated,
+ * in which case pid and status describe it */
+int WaitAny(int *semIds, int n, int flags, int *which, int *pid, int *status)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_WAITANY;
+    args.arg1   = semIds;
+    args.arg2   = (void*)(long)n;
+    args.arg3   = (void*)(long)flags;
+    USLOSS_Syscall(&args);
+
+    *which  = (int)(long)args.arg1;
+    *pid    = (int)(long)args.arg2;
+    *status = (int)(long)args.arg3;
+    return    (int)(long)args.arg4;
+}
+
+
+
 void Terminate(int status)
 {
     require_user_mode(__func__);
@@ -109,10 +235,41 @@ void CPUTime(int *cpu)
 
 
 
+/* helper function: reads phase3DataPage if it describes the calling process.
+ * Returns 1 and fills in the copy if so, 0 if the caller must trap instead.
+ */
+static int read_data_page(Phase3DataPage *copy)
+{
+    char here;   // any local lies on the caller's stack
+
+    int seq = phase3DataPage.seq;
+    if (seq & 1)
+        return 0;
+
+    copy->pid       = phase3DataPage.pid;
+    copy->stackLo   = phase3DataPage.stackLo;
+    copy->stackHi   = phase3DataPage.stackHi;
+    copy->timeOfDay = phase3DataPage.timeOfDay;
+    copy->cpuTime   = phase3DataPage.cpuTime;
+
+    if (phase3DataPage.seq != seq)
+        return 0;
+    return copy->stackLo != NULL && &here >= copy->stackLo && &here < copy->stackHi;
+}
+
+
+
 void GetPID(int *pid)
 {
     require_user_mode(__func__);
 
+    Phase3DataPage page;
+    if (read_data_page(&page))
+    {
+        *pid = page.pid;
+        return;
+    }
+
     USLOSS_Sysargs args;
     memset(&args, 0, sizeof(args));
 
@@ -124,6 +281,35 @@ void GetPID(int *pid)
 
 
 
+/* The Coarse variants never trap when the data page is current, but only
+ * advance when the process makes a syscall or a clock interrupt arrives.
+ */
+void GetTimeofDayCoarse(int *tod)
+{
+    require_user_mode(__func__);
+
+    Phase3DataPage page;
+    if (read_data_page(&page))
+        *tod = page.timeOfDay;
+    else
+        GetTimeofDay(tod);
+}
+
+
+
+void CPUTimeCoarse(int *cpu)
+{
+    require_user_mode(__func__);
+
+    Phase3DataPage page;
+    if (read_data_page(&page))
+        *cpu = page.cpuTime;
+    else
+        CPUTime(cpu);
+}
+
+
+
 int SemCreate(int value, int *semaphore)
 {
     require_user_mode(__func__);
@@ -141,6 +327,24 @@ int SemCreate(int value, int *semaphore)
 
 
 
+int SemCreateEx(int value, int flags, int *semaphore)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMCREATE;
+    args.arg1 = (void*)(long)value;
+    args.arg2 = (void*)(long)flags;
+    USLOSS_Syscall(&args);
+
+    *semaphore = (int)(long)args.arg1;
+    return       (int)(long)args.arg4;
+}
+
+
+
 int SemP(int semaphore)
 {
     require_user_mode(__func__);
@@ -187,3 +391,573 @@ int SemFree(int semaphore)
     return (int)(long)args.arg4;
 }
 
+
+
+
+int SemOp(int *semaphores, int *deltas, int n)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMOP;
+    args.arg1 = semaphores;
+    args.arg2 = deltas;
+    args.arg3 = (void*)(long)n;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int SemPn(int semaphore, int n)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMPN;
+    args.arg1 = (void*)(long)semaphore;
+    args.arg2 = (void*)(long)n;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int SemVn(int semaphore, int n)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMVN;
+    args.arg1 = (void*)(long)semaphore;
+    args.arg2 = (void*)(long)n;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int SemTryP(int semaphore)
+{
+    return SemPTimeout(semaphore, 0);
+}
+
+
+
+int SemPTimeout(int semaphore, int ticks)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMTIMEDP;
+    args.arg1 = (void*)(long)semaphore;
+    args.arg2 = (void*)(long)ticks;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int FutexWait(int *addr, int expected)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_FUTEXWAIT;
+    args.arg1 = addr;
+    args.arg2 = (void*)(long)expected;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int FutexWake(int *addr, int count)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_FUTEXWAKE;
+    args.arg1 = addr;
+    args.arg2 = (void*)(long)count;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg1;
+}
+
+
+
+/* The USem operations use compiler atomics, since a clock interrupt can switch
+ * processes between any two instructions.
+ */
+void USemInit(USem *sem, int value)
+{
+    sem->count   = value;
+    sem->waiters = 0;
+}
+
+
+
+void USemP(USem *sem)
+{
+    require_user_mode(__func__);
+
+    while (1)
+    {
+        int count = sem->count;
+        if (count > 0)
+        {
+            if (__sync_bool_compare_and_swap(&sem->count, count, count-1))
+                return;
+            continue;
+        }
+
+        /* FutexWait() rechecks the count in the kernel, so a USemV() that
+         * lands between our read and the trap just makes it return at once.
+         */
+        __sync_fetch_and_add(&sem->waiters, 1);
+        FutexWait((int*)&sem->count, 0);
+        __sync_fetch_and_sub(&sem->waiters, 1);
+    }
+}
+
+
+
+void USemV(USem *sem)
+{
+    require_user_mode(__func__);
+
+    __sync_fetch_and_add(&sem->count, 1);
+    if (sem->waiters > 0)
+        FutexWake((int*)&sem->count, 1);
+}
+
+
+
+/* helper function for the RWLock calls; see kernRWLock() */
+static int rwlock_call(int op, int arg, int *out)
+{
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_RWLOCK;
+    args.arg1   = (void*)(long)op;
+    args.arg2   = (void*)(long)arg;
+    USLOSS_Syscall(&args);
+
+    if (out != NULL)
+        *out = (int)(long)args.arg1;
+    return (int)(long)args.arg4;
+}
+
+
+
+int RWLockCreate(int flags, int *lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_CREATE, flags, lock);
+}
+
+
+
+int ReadLock(int lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_READLOCK, lock, NULL);
+}
+
+
+
+int ReadUnlock(int lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_READUNLOCK, lock, NULL);
+}
+
+
+
+int WriteLock(int lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_WRITELOCK, lock, NULL);
+}
+
+
+
+int WriteUnlock(int lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_WRITEUNLOCK, lock, NULL);
+}
+
+
+
+int RWLockFree(int lock)
+{
+    require_user_mode(__func__);
+    return rwlock_call(RWLOCK_OP_FREE, lock, NULL);
+}
+
+
+
+/* helper function for the condition variable calls; see kernCond() */
+static int cond_call(int op, int cond, int semaphore, int *out)
+{
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_COND;
+    args.arg1   = (void*)(long)op;
+    args.arg2   = (void*)(long)cond;
+    args.arg3   = (void*)(long)semaphore;
+    USLOSS_Syscall(&args);
+
+    if (out != NULL)
+        *out = (int)(long)args.arg1;
+    return (int)(long)args.arg4;
+}
+
+
+
+int CondCreate(int *cond)
+{
+    require_user_mode(__func__);
+    return cond_call(COND_OP_CREATE, 0, 0, cond);
+}
+
+
+
+/* the caller must hold semaphore, as a mutex; it holds it again on return */
+int CondWait(int cond, int semaphore)
+{
+    require_user_mode(__func__);
+    return cond_call(COND_OP_WAIT, cond, semaphore, NULL);
+}
+
+
+
+int CondSignal(int cond)
+{
+    require_user_mode(__func__);
+    return cond_call(COND_OP_SIGNAL, cond, 0, NULL);
+}
+
+
+
+int CondBroadcast(int cond)
+{
+    require_user_mode(__func__);
+    return cond_call(COND_OP_BROADCAST, cond, 0, NULL);
+}
+
+
+
+int CondFree(int cond)
+{
+    require_user_mode(__func__);
+    return cond_call(COND_OP_FREE, cond, 0, NULL);
+}
+
+
+
+/* helper function for the barrier calls; see kernBarrier() */
+static int barrier_call(int op, int arg, int *out)
+{
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_BARRIER;
+    args.arg1   = (void*)(long)op;
+    args.arg2   = (void*)(long)arg;
+    USLOSS_Syscall(&args);
+
+    if (out != NULL)
+        *out = (int)(long)args.arg1;
+    return (int)(long)args.arg4;
+}
+
+
+
+int BarrierCreate(int n, int *barrier)
+{
+    require_user_mode(__func__);
+    return barrier_call(BARRIER_OP_CREATE, n, barrier);
+}
+
+
+
+/* returns 1 in the process that released the barrier, 0 in the others */
+int BarrierWait(int barrier)
+{
+    require_user_mode(__func__);
+    return barrier_call(BARRIER_OP_WAIT, barrier, NULL);
+}
+
+
+
+int BarrierFree(int barrier)
+{
+    require_user_mode(__func__);
+    return barrier_call(BARRIER_OP_FREE, barrier, NULL);
+}
+
+
+
+/* helper function for the event flag calls; see kernFlags() */
+static int flags_call(int op, int group, unsigned int mask, int mode,
+                      unsigned int *out)
+{
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_FLAGS;
+    args.arg1   = (void*)(long)op;
+    args.arg2   = (void*)(long)group;
+    args.arg3   = (void*)(long)mask;
+    args.arg5   = (void*)(long)mode;
+    USLOSS_Syscall(&args);
+
+    int rc = (int)(long)args.arg4;
+    if (out != NULL && rc != -1)
+        *out = (unsigned int)(long)(op == FLAGS_OP_CREATE ? args.arg1 : args.arg2);
+    return rc;
+}
+
+
+
+int FlagsCreate(int *group)
+{
+    require_user_mode(__func__);
+
+    unsigned int id = (unsigned int)-1;
+    int rc = flags_call(FLAGS_OP_CREATE, 0, 0, 0, &id);
+    *group = (int)id;
+    return rc;
+}
+
+
+
+int FlagsSet(int group, unsigned int mask)
+{
+    require_user_mode(__func__);
+    return flags_call(FLAGS_OP_SET, group, mask, 0, NULL);
+}
+
+
+
+int FlagsClear(int group, unsigned int mask)
+{
+    require_user_mode(__func__);
+    return flags_call(FLAGS_OP_CLEAR, group, mask, 0, NULL);
+}
+
+
+
+/* observed, if not NULL, receives the bits that were set when the wait ended */
+int FlagsWait(int group, unsigned int mask, int mode, unsigned int *observed)
+{
+    require_user_mode(__func__);
+    return flags_call(FLAGS_OP_WAIT, group, mask, mode, observed);
+}
+
+
+
+int FlagsFree(int group)
+{
+    require_user_mode(__func__);
+    return flags_call(FLAGS_OP_FREE, group, 0, 0, NULL);
+}
+
+
+
+int SysStats(int number, SyscallStats *stats)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_STATS;
+    args.arg1   = (void*)(long)STATS_OP_SYSCALL;
+    args.arg2   = (void*)(long)number;
+    args.arg3   = stats;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+/* number is a syscall number, or -1 for the kernel lock outside any syscall */
+int LockStatsGet(int number, LockStats *stats)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_STATS;
+    args.arg1   = (void*)(long)STATS_OP_LOCK;
+    args.arg2   = (void*)(long)number;
+    args.arg3   = stats;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int SemStatsGet(int semaphore, SemStats *stats)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_STATS;
+    args.arg1   = (void*)(long)STATS_OP_SEM;
+    args.arg2   = (void*)(long)semaphore;
+    args.arg3   = stats;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+/* copies out up to max of the most recent records, oldest first, and returns
+ * how many there were */
+int SysTrace(TraceRecord *records, int max)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_STATS;
+    args.arg1   = (void*)(long)STATS_OP_TRACE;
+    args.arg2   = (void*)(long)max;
+    args.arg3   = records;
+    USLOSS_Syscall(&args);
+
+    int rc = (int)(long)args.arg4;
+    if (rc != 0)
+        return rc;
+    return (int)(long)args.arg1;
+}
+
+
+
+void BatchInit(SyscallBatch *batch, int flags)
+{
+    batch->count = 0;
+    batch->flags = flags;
+}
+
+
+
+/* returns a zeroed entry for the syscall, to be filled in by the caller, or
+ * NULL if the batch is full
+ */
+USLOSS_Sysargs *BatchAdd(SyscallBatch *batch, int number)
+{
+    if (batch->count == BATCH_MAX)
+        return NULL;
+
+    USLOSS_Sysargs *entry = &batch->entries[batch->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->number = number;
+    return entry;
+}
+
+
+
+/* The BatchAdd...() helpers return the index of the new entry, or -1 if the
+ * batch is full.
+ */
+int BatchAddSpawn(SyscallBatch *batch, char *name, int (*func)(char*),
+                  char *arg, int stack_size, int priority)
+{
+    USLOSS_Sysargs *entry = BatchAdd(batch, SYS_SPAWN);
+    if (entry == NULL)
+        return -1;
+
+    entry->arg1 = func;
+    entry->arg2 = arg;
+    entry->arg3 = (void*)(long)stack_size;
+    entry->arg4 = (void*)(long)priority;
+    entry->arg5 = name;
+    return batch->count-1;
+}
+
+
+
+int BatchAddSemCreate(SyscallBatch *batch, int value)
+{
+    USLOSS_Sysargs *entry = BatchAdd(batch, SYS_SEMCREATE);
+    if (entry == NULL)
+        return -1;
+
+    entry->arg1 = (void*)(long)value;
+    return batch->count-1;
+}
+
+
+
+int BatchAddSemP(SyscallBatch *batch, int semaphore)
+{
+    USLOSS_Sysargs *entry = BatchAdd(batch, SYS_SEMP);
+    if (entry == NULL)
+        return -1;
+
+    entry->arg1 = (void*)(long)semaphore;
+    return batch->count-1;
+}
+
+
+
+int BatchAddSemV(SyscallBatch *batch, int semaphore)
+{
+    USLOSS_Sysargs *entry = BatchAdd(batch, SYS_SEMV);
+    if (entry == NULL)
+        return -1;
+
+    entry->arg1 = (void*)(long)semaphore;
+    return batch->count-1;
+}
+
+
+
+int BatchSubmit(SyscallBatch *batch, int *completed)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_BATCH;
+    args.arg1 = batch->entries;
+    args.arg2 = (void*)(long)batch->count;
+    args.arg3 = (void*)(long)batch->flags;
+    USLOSS_Syscall(&args);
+
+    *completed = (int)(long)args.arg1;
+    return       (int)(long)args.arg4;
+}
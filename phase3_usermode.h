@@ -5,18 +5,235 @@
 #ifndef _PHASE3_USERMODE_H
 #define _PHASE3_USERMODE_H
 
+#include <usloss.h>
+
+// Phase 3 -- syscalls beyond the ones in usyscall.h
+#define SYS_SEMOP       30
+#define SYS_SEMPN       31
+#define SYS_SEMVN       32
+#define SYS_SEMTIMEDP   33
+#define SYS_FUTEXWAIT   34
+#define SYS_FUTEXWAKE   35
+#define SYS_BATCH       36
+#define SYS_SPAWNMANY   37
+#define SYS_WAITCHILD   38
+#define SYS_WAITMANY    39
+#define SYS_WAITANY     40
+#define SYS_RWLOCK      41
+#define SYS_COND        42
+#define SYS_BARRIER     43
+#define SYS_FLAGS       44
+#define SYS_STATS       45
+
+#define SEMOP_MAX       16  // most semaphores one SemOp() can adjust
+
+// SemCreateEx() flags
+#define SEM_FIFO        0x0 // wake waiters in arrival order
+#define SEM_PRIORITY    0x1 // wake waiters in priority order, FIFO within a priority
+#define SEM_INHERIT     0x2 // SEM_PRIORITY, and lend waiters' priority to the last P
+
+// SYS_RWLOCK operations, passed in arg1
+#define RWLOCK_OP_CREATE      0
+#define RWLOCK_OP_READLOCK    1
+#define RWLOCK_OP_READUNLOCK  2
+#define RWLOCK_OP_WRITELOCK   3
+#define RWLOCK_OP_WRITEUNLOCK 4
+#define RWLOCK_OP_FREE        5
+
+#define RWLOCK_WRITER_PREF 0x1 // RWLockCreate() flag: queued writers go before new readers
+
+// SYS_COND operations, passed in arg1
+#define COND_OP_CREATE    0
+#define COND_OP_WAIT      1
+#define COND_OP_SIGNAL    2
+#define COND_OP_BROADCAST 3
+#define COND_OP_FREE      4
+
+// SYS_BARRIER operations, passed in arg1
+#define BARRIER_OP_CREATE 0
+#define BARRIER_OP_WAIT   1
+#define BARRIER_OP_FREE   2
+
+// SYS_FLAGS operations, passed in arg1
+#define FLAGS_OP_CREATE 0
+#define FLAGS_OP_SET    1
+#define FLAGS_OP_CLEAR  2
+#define FLAGS_OP_WAIT   3
+#define FLAGS_OP_FREE   4
+
+#define FLAGS_ANY       0   // FlagsWait() returns once any bit of the mask is set
+#define FLAGS_ALL       1   // FlagsWait() returns once every bit of the mask is set
+
+// SYS_STATS operations, passed in arg1
+#define STATS_OP_SYSCALL 0  // copy out the SyscallStats of one syscall number
+#define STATS_OP_TRACE   1  // copy out the most recent TraceRecords
+#define STATS_OP_LOCK    2  // copy out the LockStats of one syscall handler
+#define STATS_OP_SEM     3  // copy out the SemStats of one semaphore
+
+#define TRACE_BUCKETS    16 // latency histogram buckets; see SyscallStats
+#define TRACE_RING_SIZE  64 // TraceRecords kept by the kernel
+
+#define WAITANY_MAX     16  // most semaphores one WaitAny() can watch
+#define WAITANY_CHILD   0x1 // let WaitAny() also return when a child terminates
+
+#define BATCH_MAX       32  // most syscalls in one SyscallBatch
+#define BATCH_MAY_BLOCK 0x1 // let a batch block partway instead of stopping
+
+// A list of syscalls submitted with one trap by BatchSubmit(). Entries are
+// filled in exactly as for the individual syscalls, and each entry's results
+// are found in it afterwards, in the same fields the syscall would return.
+typedef struct SyscallBatch {
+    int count;
+    int flags;
+    USLOSS_Sysargs entries[BATCH_MAX];
+} SyscallBatch;
+
+// Arguments of a SpawnMany() call, passed to the kernel as one block.
+typedef struct SpawnManyReq {
+    char  *namePrefix;
+    int  (*func)(char*);
+    char **args;      // one argument per child, or NULL for all NULL
+    int    n;
+    int    stackSize;
+    int    priority;
+    int   *pids;      // filled in with one PID per child, -1 if not created
+} SpawnManyReq;
+
+// A semaphore that lives in user memory. USemP() and USemV() only trap into
+// the kernel (through FutexWait/FutexWake) when a process has to block or be
+// woken. Initialize with USemInit() before use.
+typedef struct USem {
+    volatile int count;   // units available
+    volatile int waiters; // processes that found count at 0 and may sleep
+} USem;
+
+// Kernel-published copy of per-process information, refreshed whenever a
+// process returns from a syscall or clock interrupt. It describes whichever
+// process last ran in user mode; a process knows the page is its own when one
+// of its local variables lies between stackLo and stackHi, which are NULL for
+// processes not started by Spawn. seq is odd while the kernel is writing.
+typedef struct Phase3DataPage {
+    volatile int   seq;
+    volatile int   pid;
+    char *volatile stackLo;
+    char *volatile stackHi;
+    volatile int   timeOfDay; // currentTime() when published
+    volatile int   cpuTime;   // readtime() when published
+} Phase3DataPage;
+
+extern Phase3DataPage phase3DataPage;
+
+// Counters the kernel keeps for each syscall number. Latencies are measured
+// with currentTime() from trap to return, so they include time spent blocked.
+// histogram[0] counts calls under 1 us, and histogram[b] calls taking from
+// 2^(b-1) to 2^b - 1 us; the last bucket also holds everything slower.
+typedef struct SyscallStats {
+    int calls; // completed calls; Terminate never completes
+    int totalUs;
+    int maxUs;
+    int histogram[TRACE_BUCKETS];
+} SyscallStats;
+
+// One completed syscall, as kept in the kernel's trace ring.
+typedef struct TraceRecord {
+    int   pid;
+    int   number;
+    void *args[5];  // arg1 to arg5 as passed in
+    int   start;    // currentTime() at the trap
+    int   duration; // in microseconds
+} TraceRecord;
+
+// Use of the kernel lock (interrupts disabled) while the kernel handles one
+// syscall number, or outside any syscall, which includes syscall tracing and the
+// clock interrupt handler. The lock cannot be waited for on one
+// CPU, so instead of contention the kernel counts nested acquisitions, made
+// while the process already holds it. Hold times are CPU time of the holder, from the
+// outermost acquisition to its release, not counting time spent blocked.
+typedef struct LockStats {
+    int acquisitions;
+    int nested;
+    int totalHoldUs;
+    int maxHoldUs;
+} LockStats;
+
+// Usage counters the kernel keeps for each semaphore since it was created. P
+// counts SemP, SemPn and SemTimedP calls, SemOp calls that take from the
+// semaphore, and WaitAny calls that take their unit from it; blocked counts those
+// that had to wait. Blocked times are wall-clock time from blocking until the
+// units are handed over or the wait times out.
+typedef struct SemStats {
+    int pCount;
+    int vCount;
+    int blocked;
+    int maxWaiters; // most processes on the wait queue at once
+    int totalBlockedUs;
+    int maxBlockedUs;
+} SemStats;
+
 // Phase 3 -- User Function Prototypes
 extern int  Spawn(char *name, int (*func)(char*), char *arg, int stack_size,
                   int priority, int *pid);
+extern int  SpawnMany(char *name_prefix, int (*func)(char*), char **args, int n,
+                      int stack_size, int priority, int *pids, int *created);
 extern int  Wait(int *pid, int *status);
+extern int  WaitPid(int pid, int *status);
+extern int  WaitNoHang(int *pid, int *status);
+extern int  WaitTimeout(int *pid, int *status, int ticks);
+extern int  WaitMany(int *pids, int *statuses, int max);
+extern int  WaitAny(int *semIds, int n, int flags, int *which, int *pid,
+                    int *status);
 extern void Terminate(int status) __attribute__((__noreturn__));
 extern void GetTimeofDay(int *tod);
 extern void CPUTime(int *cpu);
 extern void GetPID(int *pid);
+extern void GetTimeofDayCoarse(int *tod);
+extern void CPUTimeCoarse(int *cpu);
 extern int  SemCreate(int value, int *semaphore);
+extern int  SemCreateEx(int value, int flags, int *semaphore);
 extern int  SemP(int semaphore);
 extern int  SemV(int semaphore);
-
-   // NOTE: No SemFree() call, it was removed
+extern int  SemFree(int semaphore);
+extern int  SemOp(int *semaphores, int *deltas, int n);
+extern int  SemPn(int semaphore, int n);
+extern int  SemVn(int semaphore, int n);
+extern int  SemTryP(int semaphore);
+extern int  SemPTimeout(int semaphore, int ticks);
+extern int  FutexWait(int *addr, int expected);
+extern int  FutexWake(int *addr, int count);
+extern void USemInit(USem *sem, int value);
+extern void USemP(USem *sem);
+extern void USemV(USem *sem);
+extern int  RWLockCreate(int flags, int *lock);
+extern int  ReadLock(int lock);
+extern int  ReadUnlock(int lock);
+extern int  WriteLock(int lock);
+extern int  WriteUnlock(int lock);
+extern int  RWLockFree(int lock);
+extern int  CondCreate(int *cond);
+extern int  CondWait(int cond, int semaphore);
+extern int  CondSignal(int cond);
+extern int  CondBroadcast(int cond);
+extern int  CondFree(int cond);
+extern int  BarrierCreate(int n, int *barrier);
+extern int  BarrierWait(int barrier);
+extern int  BarrierFree(int barrier);
+extern int  FlagsCreate(int *group);
+extern int  FlagsSet(int group, unsigned int mask);
+extern int  FlagsClear(int group, unsigned int mask);
+extern int  FlagsWait(int group, unsigned int mask, int mode,
+                      unsigned int *observed);
+extern int  FlagsFree(int group);
+extern int  SysStats(int number, SyscallStats *stats);
+extern int  SysTrace(TraceRecord *records, int max);
+extern int  LockStatsGet(int number, LockStats *stats);
+extern int  SemStatsGet(int semaphore, SemStats *stats);
+extern void BatchInit(SyscallBatch *batch, int flags);
+extern USLOSS_Sysargs *BatchAdd(SyscallBatch *batch, int number);
+extern int  BatchAddSpawn(SyscallBatch *batch, char *name, int (*func)(char*),
+                          char *arg, int stack_size, int priority);
+extern int  BatchAddSemCreate(SyscallBatch *batch, int value);
+extern int  BatchAddSemP(SyscallBatch *batch, int semaphore);
+extern int  BatchAddSemV(SyscallBatch *batch, int semaphore);
+extern int  BatchSubmit(SyscallBatch *batch, int *completed);
 
 #endif
@@ -0,0 +1,87 @@
+/*
+ * Syscall throughput benchmark: uncontended SemP/SemV pairs, a two process
+ * SemP/SemV ping-pong, and Spawn/Wait round trips. Timings come from
+ * GetTimeofDay, so build this against the old and new phase3.c to compare.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+#define SEM_ITERS    10000
+#define PING_ITERS   2000
+#define SPAWN_ITERS  500
+
+int Pinger(char *);
+int Nop(char *);
+
+int pingSem, pongSem;
+
+
+static void report(char *name, int iters, int start, int end)
+{
+    int elapsed = end - start;
+    USLOSS_Console("bench00: %-22s %6d ops in %8d us", name, iters, elapsed);
+    if (elapsed > 0)
+        USLOSS_Console(" (%d ns/op)", (int)((elapsed * 1000L) / iters));
+    USLOSS_Console("\n");
+}
+
+
+int start3(char *arg)
+{
+    int sem, pid, status, i;
+    int start, end;
+
+    SemCreate(0, &sem);
+    GetTimeofDay(&start);
+    for (i = 0; i < SEM_ITERS; i++) {
+        SemV(sem);
+        SemP(sem);
+    }
+    GetTimeofDay(&end);
+    report("SemV+SemP uncontended", SEM_ITERS, start, end);
+
+    SemCreate(0, &pingSem);
+    SemCreate(0, &pongSem);
+    Spawn("Pinger", Pinger, NULL, USLOSS_MIN_STACK, 3, &pid);
+    GetTimeofDay(&start);
+    for (i = 0; i < PING_ITERS; i++) {
+        SemV(pingSem);
+        SemP(pongSem);
+    }
+    GetTimeofDay(&end);
+    Wait(&pid, &status);
+    report("SemV/SemP ping-pong", PING_ITERS, start, end);
+
+    GetTimeofDay(&start);
+    for (i = 0; i < SPAWN_ITERS; i++) {
+        Spawn("Nop", Nop, NULL, USLOSS_MIN_STACK, 4, &pid);
+        Wait(&pid, &status);
+    }
+    GetTimeofDay(&end);
+    report("Spawn+Wait", SPAWN_ITERS, start, end);
+
+    Terminate(0);
+}
+
+
+int Pinger(char *arg)
+{
+    int i;
+
+    for (i = 0; i < PING_ITERS; i++) {
+        SemP(pingSem);
+        SemV(pongSem);
+    }
+    return 0;
+}
+
+
+int Nop(char *arg)
+{
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Futex fast path benchmark: uncontended kernel SemV/SemP against the
+ * user-space USemV/USemP, which should not trap at all, plus a two process
+ * ping-pong where every USem operation has to go through the kernel.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+#define SEM_ITERS    10000
+#define PING_ITERS   2000
+
+int Pinger(char *);
+
+USem ping, pong;
+
+
+static void report(char *name, int iters, int start, int end)
+{
+    int elapsed = end - start;
+    USLOSS_Console("bench01: %-23s %6d ops in %8d us", name, iters, elapsed);
+    if (elapsed > 0)
+        USLOSS_Console(" (%d ns/op)", (int)((elapsed * 1000L) / iters));
+    USLOSS_Console("\n");
+}
+
+
+int start3(char *arg)
+{
+    int sem, pid, status, i;
+    int start, end;
+    USem usem;
+
+    SemCreate(0, &sem);
+    GetTimeofDay(&start);
+    for (i = 0; i < SEM_ITERS; i++) {
+        SemV(sem);
+        SemP(sem);
+    }
+    GetTimeofDay(&end);
+    report("SemV+SemP uncontended", SEM_ITERS, start, end);
+
+    USemInit(&usem, 0);
+    GetTimeofDay(&start);
+    for (i = 0; i < SEM_ITERS; i++) {
+        USemV(&usem);
+        USemP(&usem);
+    }
+    GetTimeofDay(&end);
+    report("USemV+USemP uncontended", SEM_ITERS, start, end);
+
+    USemInit(&ping, 0);
+    USemInit(&pong, 0);
+    Spawn("Pinger", Pinger, NULL, USLOSS_MIN_STACK, 3, &pid);
+    GetTimeofDay(&start);
+    for (i = 0; i < PING_ITERS; i++) {
+        USemV(&ping);
+        USemP(&pong);
+    }
+    GetTimeofDay(&end);
+    Wait(&pid, &status);
+    report("USemV/USemP ping-pong", PING_ITERS, start, end);
+
+    Terminate(0);
+}
+
+
+int Pinger(char *arg)
+{
+    int i;
+
+    for (i = 0; i < PING_ITERS; i++) {
+        USemP(&ping);
+        USemV(&pong);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Fan-out benchmark: time to create a batch of low priority children with a
+ * loop of Spawn calls against a single SpawnMany call. The children do not run
+ * until start3 Waits for them, so only creation is timed. Then the time to reap
+ * a batch with a loop of Wait calls against WaitMany.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+#define FANOUT  40
+#define ROUNDS  20
+
+int Nop(char *);
+
+
+static void report(char *name, int iters, int start, int end)
+{
+    int elapsed = end - start;
+    USLOSS_Console("bench02: %-16s %4d rounds of %d in %8d us", name, iters, FANOUT, elapsed);
+    if (elapsed > 0)
+        USLOSS_Console(" (%d us/round)", elapsed / iters);
+    USLOSS_Console("\n");
+}
+
+
+static void reap(int n)
+{
+    int pid, status, i;
+
+    for (i = 0; i < n; i++)
+        Wait(&pid, &status);
+}
+
+
+static void reap_many(int n)
+{
+    int pids[FANOUT], statuses[FANOUT];
+
+    while (n > 0)
+        n -= WaitMany(pids, statuses, FANOUT);
+}
+
+
+int start3(char *arg)
+{
+    int pids[FANOUT];
+    int start, end, elapsed, created, i, j;
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        GetTimeofDay(&start);
+        for (j = 0; j < FANOUT; j++)
+            Spawn("Nop", Nop, NULL, USLOSS_MIN_STACK, 5, &pids[j]);
+        GetTimeofDay(&end);
+        elapsed += end - start;
+        reap(FANOUT);
+    }
+    report("Spawn loop", ROUNDS, 0, elapsed);
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        GetTimeofDay(&start);
+        SpawnMany("Nop", Nop, NULL, FANOUT, USLOSS_MIN_STACK, 5, pids, &created);
+        GetTimeofDay(&end);
+        elapsed += end - start;
+        reap(FANOUT);
+    }
+    report("SpawnMany", ROUNDS, 0, elapsed);
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        SpawnMany("Nop", Nop, NULL, FANOUT, USLOSS_MIN_STACK, 5, pids, &created);
+        GetTimeofDay(&start);
+        reap(FANOUT);
+        GetTimeofDay(&end);
+        elapsed += end - start;
+    }
+    report("Wait loop", ROUNDS, 0, elapsed);
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        SpawnMany("Nop", Nop, NULL, FANOUT, USLOSS_MIN_STACK, 5, pids, &created);
+        GetTimeofDay(&start);
+        reap_many(FANOUT);
+        GetTimeofDay(&end);
+        elapsed += end - start;
+    }
+    report("WaitMany", ROUNDS, 0, elapsed);
+
+    Terminate(0);
+}
+
+
+int Nop(char *arg)
+{
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Spawn latency benchmark: Spawn+Wait round trips with the child at higher,
+ * equal and lower priority than start3 (which runs at priority 3). A higher
+ * priority child runs inside Spawn; a lower priority one runs inside Wait.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+#define SPAWN_ITERS  300
+
+int Nop(char *);
+
+
+int start3(char *arg)
+{
+    int pid, status, priority, i;
+    int start, end, elapsed;
+
+    for (priority = 1; priority <= 5; priority++) {
+        GetTimeofDay(&start);
+        for (i = 0; i < SPAWN_ITERS; i++) {
+            Spawn("Nop", Nop, NULL, USLOSS_MIN_STACK, priority, &pid);
+            Wait(&pid, &status);
+        }
+        GetTimeofDay(&end);
+        elapsed = end - start;
+        USLOSS_Console("bench03: child priority %d: %4d Spawn+Wait in %8d us (%d us each)\n",
+                       priority, SPAWN_ITERS, elapsed, elapsed / SPAWN_ITERS);
+    }
+
+    Terminate(0);
+}
+
+
+int Nop(char *arg)
+{
+    return 0;
+}
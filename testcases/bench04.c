@@ -0,0 +1,76 @@
+/*
+ * Tree teardown benchmark: the time from a child calling Terminate until start3
+ * learns of it, when that child still has a busy grandchild to join. Wait must
+ * wait for the grandchild to finish; WaitPid returns as soon as the child's exit
+ * is recorded.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+#define ROUNDS        10
+#define LEAF_SPIN_US  20000
+
+int Middle(char *);
+int Leaf(char *);
+
+static int exitStart;
+
+
+static void report(char *name, int elapsed)
+{
+    USLOSS_Console("bench04: %-8s %4d rounds in %8d us (%d us/round)\n",
+                   name, ROUNDS, elapsed, elapsed / ROUNDS);
+}
+
+
+int start3(char *arg)
+{
+    int pid, status, now, elapsed, i;
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        Spawn("Middle", Middle, NULL, USLOSS_MIN_STACK, 4, &pid);
+        Wait(&pid, &status);
+        GetTimeofDay(&now);
+        elapsed += now - exitStart;
+    }
+    report("Wait", elapsed);
+
+    elapsed = 0;
+    for (i = 0; i < ROUNDS; i++) {
+        Spawn("Middle", Middle, NULL, USLOSS_MIN_STACK, 4, &pid);
+        WaitPid(pid, &status);
+        GetTimeofDay(&now);
+        elapsed += now - exitStart;
+    }
+    report("WaitPid", elapsed);
+
+    Terminate(0);
+}
+
+
+int Middle(char *arg)
+{
+    int pid;
+
+    Spawn("Leaf", Leaf, NULL, USLOSS_MIN_STACK, 5, &pid);
+    GetTimeofDay(&exitStart);
+    return 0;
+}
+
+
+int Leaf(char *arg)
+{
+    int start, now;
+
+    GetTimeofDay(&start);
+    do {
+        GetTimeofDay(&now);
+    } while (now - start < LEAF_SPIN_US);
+    return 0;
+}
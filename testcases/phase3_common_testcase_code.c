@@ -7,6 +7,7 @@
 #include "phase3_usermode.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 
@@ -87,6 +88,14 @@ void phase5_start_service_processes()
 void finish(int argc, char **argv)
 {
     USLOSS_Console("%s(): The simulation is now terminating.\n", __func__);
+
+    /* kernel instrumentation; off by default so the expected output matches */
+    if (getenv("PHASE3_STATS") != NULL) {
+        dumpSyscallStats();
+        dumpLockStats();
+        dumpSemTable();
+        dumpSemStats();
+    }
 }
 
 void test_setup  (int argc, char **argv) {}
@@ -0,0 +1,58 @@
+/*
+ * SemFree test: two processes blocked on a semaphore are woken with -1 when it
+ * is freed, and the old id stops working even after its slot is reused.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Child1(char *);
+
+int semaphore;
+
+
+int start3(char *arg)
+{
+    int pid1, pid2, status;
+    int free_result, new_semaphore;
+
+    USLOSS_Console("start3(): started.  Creating semaphore.\n");
+    SemCreate(0, &semaphore);
+
+    USLOSS_Console("start3(): calling Spawn for Child1 (twice)\n");
+    Spawn("Child1a", Child1, "Child1a", USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("Child1b", Child1, "Child1b", USLOSS_MIN_STACK, 2, &pid2);
+
+    USLOSS_Console("start3(): freeing semaphore %d\n", semaphore);
+    free_result = SemFree(semaphore);
+    WaitPid(pid1, &status);
+    WaitPid(pid2, &status);
+    USLOSS_Console("start3(): SemFree returned %d (1 means processes were blocked)\n", free_result);
+
+    USLOSS_Console("start3(): SemFree again returned %d\n", SemFree(semaphore));
+    USLOSS_Console("start3(): SemV on freed id returned %d\n", SemV(semaphore));
+
+    SemCreate(1, &new_semaphore);
+    USLOSS_Console("start3(): new semaphore %d reuses the slot of %d\n", new_semaphore, semaphore);
+    USLOSS_Console("start3(): SemP on old id returned %d\n", SemP(semaphore));
+    USLOSS_Console("start3(): SemP on new id returned %d\n", SemP(new_semaphore));
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Child1(char *arg)
+{
+    int result;
+
+    USLOSS_Console("%s(): starting, P'ing semaphore\n", arg);
+    result = SemP(semaphore);
+    USLOSS_Console("%s(): SemP returned %d\n", arg, result);
+
+    return 9;
+}
@@ -0,0 +1,60 @@
+/*
+ * SemOp test.  A SemOp that cannot take from both semaphores takes from
+ * neither, and blocks until it can take from both.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Child1(char *);
+
+int semA, semB;
+
+
+int start3(char *arg)
+{
+    int pid, status;
+    int sems[2];
+    int deltas[2];
+
+    USLOSS_Console("start3(): started.  Creating semaphores.\n");
+    SemCreate(1, &semA);
+    SemCreate(0, &semB);
+
+    /* SemOp: A has a unit but B does not, so the child takes neither */
+    USLOSS_Console("start3(): calling Spawn for Child1\n");
+    Spawn("Child1", Child1, NULL, USLOSS_MIN_STACK, 2, &pid);
+    USLOSS_Console("start3(): SemTryP(A) returned %d, so A was left alone\n", SemTryP(semA));
+    SemV(semA);
+    USLOSS_Console("start3(): V'ing B\n");
+    SemV(semB);
+    WaitPid(pid, &status);
+    USLOSS_Console("start3(): after Child1, SemTryP(A) = %d, SemTryP(B) = %d\n",
+                   SemTryP(semA), SemTryP(semB));
+
+    sems[0] = semA;
+    deltas[0] = -1;
+    USLOSS_Console("start3(): SemOp with no entries returned %d\n", SemOp(sems, deltas, 0));
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Child1(char *arg)
+{
+    int sems[2] = { semA, semB };
+    int deltas[2] = { -1, -1 };
+    int result;
+
+    USLOSS_Console("Child1(): starting, SemOp taking one unit each of A and B\n");
+    result = SemOp(sems, deltas, 2);
+    USLOSS_Console("Child1(): SemOp returned %d\n", result);
+
+    return 9;
+}
+
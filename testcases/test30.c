@@ -0,0 +1,61 @@
+/*
+ * WaitPid, WaitNoHang and WaitTimeout test.  Checks the result of each call
+ * with no children, with a child still running, and with a child that has
+ * terminated.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int ChildA(char *);
+
+int gate;
+
+
+int start3(char *arg)
+{
+    int pid, pidA, status, result;
+
+    USLOSS_Console("start3(): started\n");
+    SemCreate(0, &gate);
+
+    result = WaitNoHang(&pid, &status);
+    USLOSS_Console("start3(): WaitNoHang with no children returned %d\n", result);
+    result = WaitPid(-1, &status);
+    USLOSS_Console("start3(): WaitPid(-1) with no children returned %d\n", result);
+
+    /* a lower priority child that does not run until start3 blocks */
+    Spawn("ChildA", ChildA, NULL, USLOSS_MIN_STACK, 4, &pidA);
+    USLOSS_Console("start3(): after spawn of %d\n", pidA);
+
+    result = WaitNoHang(&pid, &status);
+    USLOSS_Console("start3(): WaitNoHang with a running child returned %d\n", result);
+    result = WaitTimeout(&pid, &status, -1);
+    USLOSS_Console("start3(): WaitTimeout with negative ticks returned %d\n", result);
+    result = WaitTimeout(&pid, &status, 2);
+    USLOSS_Console("start3(): WaitTimeout returned %d\n", result);
+
+    SemV(gate);
+    result = WaitPid(pidA, &status);
+    USLOSS_Console("start3(): WaitPid(%d) returned %d, status %d\n", pidA, result, status);
+    result = WaitPid(pidA, &status);
+    USLOSS_Console("start3(): WaitPid(%d) again returned %d\n", pidA, result);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int ChildA(char *arg)
+{
+    USLOSS_Console("ChildA(): starting, P'ing gate\n");
+    SemP(gate);
+    USLOSS_Console("ChildA(): done\n");
+
+    return 11;
+}
+
@@ -0,0 +1,65 @@
+/*
+ * RWLock test: a writer-preferring RWLock admits a queued writer before a
+ * later reader, and an unlock without a matching hold fails.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Writer(char *);
+int Reader(char *);
+
+int lock;
+
+
+int start3(char *arg)
+{
+    int pid1, pid2, status;
+
+    USLOSS_Console("start3(): started\n");
+
+    /* a reader arriving after a queued writer waits behind it */
+    RWLockCreate(RWLOCK_WRITER_PREF, &lock);
+    USLOSS_Console("start3(): ReadLock returned %d\n", ReadLock(lock));
+    Spawn("Writer", Writer, NULL, USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("Reader", Reader, NULL, USLOSS_MIN_STACK, 2, &pid2);
+    USLOSS_Console("start3(): releasing the read lock\n");
+    ReadUnlock(lock);
+    WaitPid(pid1, &status);
+    WaitPid(pid2, &status);
+    USLOSS_Console("start3(): ReadUnlock without a hold returned %d\n", ReadUnlock(lock));
+    USLOSS_Console("start3(): WriteUnlock without a hold returned %d\n", WriteUnlock(lock));
+    RWLockFree(lock);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Writer(char *arg)
+{
+    USLOSS_Console("Writer(): starting, WriteLock\n");
+    WriteLock(lock);
+    USLOSS_Console("Writer(): got the write lock\n");
+    WriteUnlock(lock);
+    USLOSS_Console("Writer(): done\n");
+
+    return 9;
+}
+
+
+int Reader(char *arg)
+{
+    USLOSS_Console("Reader(): starting, ReadLock\n");
+    ReadLock(lock);
+    USLOSS_Console("Reader(): got the read lock\n");
+    ReadUnlock(lock);
+    USLOSS_Console("Reader(): done\n");
+
+    return 9;
+}
+
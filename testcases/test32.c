@@ -0,0 +1,90 @@
+/*
+ * Priority semaphore test: waiters on a SEM_PRIORITY semaphore are woken in
+ * priority order, FIFO within a priority.  A high priority process waiting on
+ * a SEM_INHERIT semaphore lends its priority to the owner, which moves ahead
+ * of an equal priority waiter in the queue of the semaphore it is blocked on.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Waiter(char *);
+int Owner(char *);
+int High(char *);
+
+int sem;
+int lock;
+
+
+int start3(char *arg)
+{
+    int pids[4], pid, pidO, pidE, pidH, status, i;
+
+    USLOSS_Console("start3(): started\n");
+
+    /* each waiter runs as soon as it is spawned and blocks on sem */
+    SemCreateEx(0, SEM_PRIORITY, &sem);
+    Spawn("WaiterA2", Waiter, "WaiterA2", USLOSS_MIN_STACK, 2, &pids[0]);
+    Spawn("WaiterB1", Waiter, "WaiterB1", USLOSS_MIN_STACK, 1, &pids[1]);
+    Spawn("WaiterC2", Waiter, "WaiterC2", USLOSS_MIN_STACK, 2, &pids[2]);
+    Spawn("WaiterD1", Waiter, "WaiterD1", USLOSS_MIN_STACK, 1, &pids[3]);
+    for (i = 0; i < 4; i++) {
+        SemV(sem);
+        pid = WaitPid(-1, &status);
+        USLOSS_Console("start3(): V %d woke pid %d\n", i + 1, pid);
+    }
+
+    /* Owner takes lock and waits on sem behind WaiterE, of the same
+     * priority; High's wait on lock boosts Owner ahead of WaiterE */
+    SemCreateEx(1, SEM_INHERIT, &lock);
+    Spawn("WaiterE2", Waiter, "WaiterE2", USLOSS_MIN_STACK, 2, &pidE);
+    Spawn("Owner", Owner, NULL, USLOSS_MIN_STACK, 2, &pidO);
+    Spawn("High", High, NULL, USLOSS_MIN_STACK, 1, &pidH);
+    USLOSS_Console("start3(): V'ing sem once\n");
+    SemV(sem);
+    WaitPid(pidO, &status);
+    WaitPid(pidH, &status);
+    USLOSS_Console("start3(): V'ing sem again\n");
+    SemV(sem);
+    WaitPid(pidE, &status);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Waiter(char *arg)
+{
+    USLOSS_Console("%s(): P'ing sem\n", arg);
+    SemP(sem);
+    USLOSS_Console("%s(): got sem\n", arg);
+
+    return 9;
+}
+
+
+int Owner(char *arg)
+{
+    USLOSS_Console("Owner(): P'ing lock, then sem\n");
+    SemP(lock);
+    SemP(sem);
+    USLOSS_Console("Owner(): got sem, V'ing lock\n");
+    SemV(lock);
+
+    return 9;
+}
+
+
+int High(char *arg)
+{
+    USLOSS_Console("High(): P'ing lock\n");
+    SemP(lock);
+    USLOSS_Console("High(): got lock\n");
+    SemV(lock);
+
+    return 9;
+}
@@ -0,0 +1,52 @@
+/*
+ * SemPn/SemVn test.  A waiter for several units is overtaken by single-unit
+ * P's only a limited number of times, and is woken by a SemVn that brings the
+ * semaphore up to what it asked for.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Child2(char *);
+
+int semC;
+
+
+int start3(char *arg)
+{
+    int pid, status, i;
+
+    USLOSS_Console("start3(): started.  Creating semaphore.\n");
+    SemCreate(0, &semC);
+
+    /* the child wants 3 units; single units may overtake it 4 times */
+    USLOSS_Console("start3(): calling Spawn for Child2\n");
+    Spawn("Child2", Child2, NULL, USLOSS_MIN_STACK, 2, &pid);
+    for (i = 0; i < 5; i++) {
+        SemV(semC);
+        USLOSS_Console("start3(): V then SemTryP(C) returned %d\n", SemTryP(semC));
+    }
+    USLOSS_Console("start3(): SemPn(C, 0) returned %d\n", SemPn(semC, 0));
+    USLOSS_Console("start3(): calling SemVn(C, 2)\n");
+    SemVn(semC, 2);
+    WaitPid(pid, &status);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Child2(char *arg)
+{
+    int result;
+
+    USLOSS_Console("Child2(): starting, SemPn(C, 3)\n");
+    result = SemPn(semC, 3);
+    USLOSS_Console("Child2(): SemPn returned %d\n", result);
+
+    return 9;
+}
@@ -0,0 +1,35 @@
+/*
+ * SemTryP and SemPTimeout test.  A try P on an empty semaphore fails at once,
+ * a timed P on an empty semaphore gives up, and both take a unit when one is
+ * there.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int semC;
+
+
+int start3(char *arg)
+{
+    USLOSS_Console("start3(): started.  Creating semaphore.\n");
+    SemCreate(0, &semC);
+
+    USLOSS_Console("start3(): SemTryP(C) on an empty semaphore returned %d\n",
+                   SemTryP(semC));
+    SemV(semC);
+    USLOSS_Console("start3(): SemTryP(C) with a unit returned %d\n", SemTryP(semC));
+
+    USLOSS_Console("start3(): SemPTimeout(C, 2) on an empty semaphore returned %d\n",
+                   SemPTimeout(semC, 2));
+    SemV(semC);
+    USLOSS_Console("start3(): SemPTimeout(C, 2) with a unit returned %d\n",
+                   SemPTimeout(semC, 2));
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
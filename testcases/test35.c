@@ -0,0 +1,49 @@
+/*
+ * WaitMany test.  Reaps children that have already terminated, no more than
+ * the maximum asked for at a time, in the order they terminated.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Quick(char *);
+
+
+int start3(char *arg)
+{
+    int pid, n, i;
+    int pids[5], statuses[5];
+
+    USLOSS_Console("start3(): started\n");
+
+    /* three children that terminate as soon as they are spawned */
+    Spawn("Quick1", Quick, "Quick1", USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Quick2", Quick, "Quick2", USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Quick3", Quick, "Quick3", USLOSS_MIN_STACK, 2, &pid);
+
+    n = WaitMany(pids, statuses, 2);
+    USLOSS_Console("start3(): WaitMany(max 2) returned %d\n", n);
+    for (i = 0; i < n; i++)
+        USLOSS_Console("start3():     pid %d, status %d\n", pids[i], statuses[i]);
+    n = WaitMany(pids, statuses, 5);
+    USLOSS_Console("start3(): WaitMany(max 5) returned %d\n", n);
+    for (i = 0; i < n; i++)
+        USLOSS_Console("start3():     pid %d, status %d\n", pids[i], statuses[i]);
+    n = WaitMany(pids, statuses, 5);
+    USLOSS_Console("start3(): WaitMany with no children returned %d\n", n);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Quick(char *arg)
+{
+    USLOSS_Console("%s(): returning %c\n", arg, arg[5]);
+
+    return arg[5] - '0';
+}
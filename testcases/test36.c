@@ -0,0 +1,58 @@
+/*
+ * WaitAny test.  Waits over two semaphores, over a semaphore and a child
+ * exit, and with nothing to wait for.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int ChildW(char *);
+
+int s1, s2;
+
+
+int start3(char *arg)
+{
+    int pid, status, result, which;
+    int sems[2];
+
+    USLOSS_Console("start3(): started\n");
+
+    /* s2 has a unit, so the first WaitAny returns at once */
+    SemCreate(0, &s1);
+    SemCreate(1, &s2);
+    sems[0] = s1;
+    sems[1] = s2;
+    result = WaitAny(sems, 2, 0, &which, &pid, &status);
+    USLOSS_Console("start3(): WaitAny returned %d, which = %d\n", result, which);
+
+    /* a lower priority child that does not run until start3 blocks */
+    Spawn("ChildW", ChildW, NULL, USLOSS_MIN_STACK, 4, &pid);
+    USLOSS_Console("start3(): after spawn of %d\n", pid);
+    result = WaitAny(sems, 2, WAITANY_CHILD, &which, &pid, &status);
+    USLOSS_Console("start3(): WaitAny returned %d, which = %d\n", result, which);
+    result = WaitAny(sems, 1, WAITANY_CHILD, &which, &pid, &status);
+    USLOSS_Console("start3(): WaitAny returned %d, which = %d, pid %d, status %d\n",
+                   result, which, pid, status);
+
+    result = WaitAny(NULL, 0, 0, &which, &pid, &status);
+    USLOSS_Console("start3(): WaitAny with nothing to wait for returned %d\n", result);
+    result = WaitAny(NULL, 0, WAITANY_CHILD, &which, &pid, &status);
+    USLOSS_Console("start3(): WaitAny with no children returned %d\n", result);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int ChildW(char *arg)
+{
+    USLOSS_Console("ChildW(): V'ing s1\n");
+    SemV(s1);
+
+    return 7;
+}
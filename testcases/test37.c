@@ -0,0 +1,51 @@
+/*
+ * Condition variable test: CondWait returns when it is signaled while still
+ * releasing its mutex.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Signaler(char *);
+
+int cond, mutex;
+
+
+int start3(char *arg)
+{
+    int pid, status, result;
+
+    USLOSS_Console("start3(): started\n");
+
+    /* the signal may arrive before start3 has blocked */
+    CondCreate(&cond);
+    SemCreate(1, &mutex);
+    SemP(mutex);
+    Spawn("Signaler", Signaler, NULL, USLOSS_MIN_STACK, 2, &pid);
+    USLOSS_Console("start3(): calling CondWait\n");
+    result = CondWait(cond, mutex);
+    WaitPid(pid, &status);
+    USLOSS_Console("start3(): CondWait returned %d\n", result);
+    SemV(mutex);
+    CondFree(cond);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Signaler(char *arg)
+{
+    USLOSS_Console("Signaler(): starting, P'ing mutex\n");
+    SemP(mutex);
+    USLOSS_Console("Signaler(): signaling\n");
+    CondSignal(cond);
+    SemV(mutex);
+    USLOSS_Console("Signaler(): done\n");
+
+    return 9;
+}
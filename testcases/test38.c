@@ -0,0 +1,50 @@
+/*
+ * Barrier test: a barrier of three releases its workers once all have
+ * arrived, and is reused for a second round.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Worker(char *);
+
+int barrier;
+
+
+int start3(char *arg)
+{
+    int pid1, pid2, pid3, status;
+
+    USLOSS_Console("start3(): started\n");
+
+    BarrierCreate(3, &barrier);
+    Spawn("Worker1", Worker, "Worker1", USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("Worker2", Worker, "Worker2", USLOSS_MIN_STACK, 2, &pid2);
+    Spawn("Worker3", Worker, "Worker3", USLOSS_MIN_STACK, 2, &pid3);
+    WaitPid(pid1, &status);
+    WaitPid(pid2, &status);
+    WaitPid(pid3, &status);
+    BarrierFree(barrier);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Worker(char *arg)
+{
+    int round, result;
+
+    for (round = 1; round <= 2; round++) {
+        USLOSS_Console("%s(): arriving for round %d\n", arg, round);
+        result = BarrierWait(barrier);
+        USLOSS_Console("%s(): passed round %d%s\n", arg, round,
+                       result == 1 ? ", released it" : "");
+    }
+
+    return 9;
+}
@@ -0,0 +1,62 @@
+/*
+ * Event flag test: waits end on any or all of their bits, and a wait that is
+ * already satisfied returns at once.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int FlagWaiter(char *);
+
+int group;
+
+
+int start3(char *arg)
+{
+    int pid1, pid2, status, result;
+    unsigned int observed;
+
+    USLOSS_Console("start3(): started\n");
+
+    FlagsCreate(&group);
+    Spawn("WaitAll", FlagWaiter, "WaitAll", USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("WaitAny", FlagWaiter, "WaitAny", USLOSS_MIN_STACK, 2, &pid2);
+    USLOSS_Console("start3(): setting 0x1, then 0x4, then 0x2\n");
+    FlagsSet(group, 0x1);
+    FlagsSet(group, 0x4);
+    FlagsSet(group, 0x2);
+    WaitPid(pid1, &status);
+    WaitPid(pid2, &status);
+    result = FlagsWait(group, 0x3, FLAGS_ALL, &observed);
+    USLOSS_Console("start3(): FlagsWait(0x3, ALL) returned %d, observed 0x%x\n", result, observed);
+    FlagsClear(group, 0x2);
+    result = FlagsWait(group, 0x3, FLAGS_ANY, &observed);
+    USLOSS_Console("start3(): FlagsWait(0x3, ANY) returned %d, observed 0x%x\n", result, observed);
+    FlagsFree(group);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int FlagWaiter(char *arg)
+{
+    unsigned int observed;
+    int result;
+
+    if (arg[5] == 'l') {
+        USLOSS_Console("%s(): waiting for all of 0x3\n", arg);
+        result = FlagsWait(group, 0x3, FLAGS_ALL, &observed);
+    }
+    else {
+        USLOSS_Console("%s(): waiting for any of 0x6\n", arg);
+        result = FlagsWait(group, 0x6, FLAGS_ANY, &observed);
+    }
+    USLOSS_Console("%s(): FlagsWait returned %d, observed 0x%x\n", arg, result, observed);
+
+    return 9;
+}
@@ -0,0 +1,88 @@
+/*
+ * SYS_BATCH test.  Without BATCH_MAY_BLOCK a batch stops at a P with no units,
+ * marking that entry with 1, and before any call that might block.  With
+ * BATCH_MAY_BLOCK the batch blocks partway and resumes with the next entry.
+ * Terminate and nested batches are rejected.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int BatchChild(char *);
+
+int sem, gate, done;
+
+
+int start3(char *arg)
+{
+    SyscallBatch batch;
+    int pid, status, result, completed;
+
+    USLOSS_Console("start3(): started\n");
+    SemCreate(1, &sem);
+    SemCreate(0, &gate);
+    SemCreate(0, &done);
+
+    /* the second P finds no unit, so the V after it does not run */
+    BatchInit(&batch, 0);
+    BatchAddSemP(&batch, sem);
+    BatchAddSemP(&batch, sem);
+    BatchAddSemV(&batch, sem);
+    result = BatchSubmit(&batch, &completed);
+    USLOSS_Console("start3(): BatchSubmit returned %d, completed %d\n", result, completed);
+    USLOSS_Console("start3():     entry 0 arg4 = %d, entry 1 arg4 = %d\n",
+                   (int)(long)batch.entries[0].arg4, (int)(long)batch.entries[1].arg4);
+    USLOSS_Console("start3(): SemTryP afterwards returned %d\n", SemTryP(sem));
+
+    /* a wait for a child might block, so the batch stops before it */
+    BatchInit(&batch, 0);
+    BatchAddSemV(&batch, sem);
+    BatchAdd(&batch, SYS_WAIT);
+    result = BatchSubmit(&batch, &completed);
+    USLOSS_Console("start3(): BatchSubmit with a Wait returned %d, completed %d\n",
+                   result, completed);
+
+    /* the child's batch blocks on gate, then V's done */
+    Spawn("BatchChild", BatchChild, NULL, USLOSS_MIN_STACK, 2, &pid);
+    USLOSS_Console("start3(): V'ing gate\n");
+    SemV(gate);
+    SemP(done);
+    USLOSS_Console("start3(): got done\n");
+    WaitPid(pid, &status);
+
+    BatchInit(&batch, 0);
+    BatchAddSemV(&batch, sem);
+    BatchAdd(&batch, SYS_TERMINATE);
+    result = BatchSubmit(&batch, &completed);
+    USLOSS_Console("start3(): BatchSubmit with a Terminate returned %d, completed %d\n",
+                   result, completed);
+
+    BatchInit(&batch, 0);
+    BatchAdd(&batch, SYS_BATCH);
+    result = BatchSubmit(&batch, &completed);
+    USLOSS_Console("start3(): nested BatchSubmit returned %d, completed %d\n",
+                   result, completed);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int BatchChild(char *arg)
+{
+    SyscallBatch batch;
+    int result, completed;
+
+    USLOSS_Console("BatchChild(): submitting P(gate), V(done) with BATCH_MAY_BLOCK\n");
+    BatchInit(&batch, BATCH_MAY_BLOCK);
+    BatchAddSemP(&batch, gate);
+    BatchAddSemV(&batch, done);
+    result = BatchSubmit(&batch, &completed);
+    USLOSS_Console("BatchChild(): BatchSubmit returned %d, completed %d\n", result, completed);
+
+    return 9;
+}
@@ -0,0 +1,56 @@
+/*
+ * SpawnMany test.  Asking for more children than the process table can hold
+ * creates as many as fit: the call reports partial success, the created count
+ * matches the PIDs filled in, and each child created can be waited for.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int Nop(char *);
+
+int pids[MAXPROC];
+
+
+int start3(char *arg)
+{
+    int result, created, filled, reaped, status, i;
+
+    USLOSS_Console("start3(): started\n");
+
+    result = SpawnMany("Nop", Nop, NULL, 0, USLOSS_MIN_STACK, 5, pids, &created);
+    USLOSS_Console("start3(): SpawnMany of 0 children returned %d, created %d\n",
+                   result, created);
+
+    /* some process table slots are already taken, so not all of these fit */
+    result = SpawnMany("Nop", Nop, NULL, MAXPROC, USLOSS_MIN_STACK, 5, pids, &created);
+    filled = 0;
+    for (i = 0; i < MAXPROC && pids[i] != -1; i++)
+        filled++;
+    USLOSS_Console("start3(): SpawnMany of %d children returned %d\n", MAXPROC, result);
+    USLOSS_Console("start3(): created between 1 and %d: %s\n", MAXPROC - 1,
+                   created > 0 && created < MAXPROC ? "yes" : "no");
+    USLOSS_Console("start3(): created matches the PIDs filled in: %s\n",
+                   created == filled ? "yes" : "no");
+
+    reaped = 0;
+    for (i = 0; i < created; i++) {
+        if (WaitPid(pids[i], &status) == 0 && status == 3)
+            reaped++;
+    }
+    USLOSS_Console("start3(): every child created was reaped: %s\n",
+                   reaped == created ? "yes" : "no");
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int Nop(char *arg)
+{
+    return 3;
+}
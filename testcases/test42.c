@@ -0,0 +1,82 @@
+/*
+ * Futex and USem test.  FutexWait returns at once if the word has already
+ * changed; FutexWake reports how many it woke and wakes the oldest waiters
+ * first; a USem handed from start3 to a blocked consumer wakes it.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int FutexWaiter(char *);
+int Consumer(char *);
+
+int word;
+USem usem;
+
+
+int start3(char *arg)
+{
+    int pid1, pid2, pid3, status, woken1, woken2;
+
+    USLOSS_Console("start3(): started\n");
+
+    word = 5;
+    USLOSS_Console("start3(): FutexWait(4) with the word at 5 returned %d\n",
+                   FutexWait(&word, 4));
+    USLOSS_Console("start3(): FutexWake with no waiters returned %d\n",
+                   FutexWake(&word, 1));
+
+    /* each waiter runs as soon as it is spawned and blocks on the word */
+    word = 0;
+    Spawn("Waiter1", FutexWaiter, "Waiter1", USLOSS_MIN_STACK, 2, &pid1);
+    Spawn("Waiter2", FutexWaiter, "Waiter2", USLOSS_MIN_STACK, 2, &pid2);
+    Spawn("Waiter3", FutexWaiter, "Waiter3", USLOSS_MIN_STACK, 2, &pid3);
+    word = 1;
+    woken1 = FutexWake(&word, 2);
+    WaitPid(pid1, &status);
+    WaitPid(pid2, &status);
+    woken2 = FutexWake(&word, 5);
+    WaitPid(pid3, &status);
+    USLOSS_Console("start3(): FutexWake(2) woke %d, FutexWake(5) woke %d\n",
+                   woken1, woken2);
+
+    /* the consumer blocks in USemP before start3 V's */
+    USemInit(&usem, 0);
+    Spawn("Consumer", Consumer, NULL, USLOSS_MIN_STACK, 2, &pid1);
+    USemV(&usem);
+    USemV(&usem);
+    WaitPid(pid1, &status);
+    USLOSS_Console("start3(): afterwards count %d, waiters %d\n",
+                   usem.count, usem.waiters);
+
+    USLOSS_Console("start3(): Parent done. Calling Terminate.\n");
+    Terminate(0);
+}
+
+
+int FutexWaiter(char *arg)
+{
+    int result;
+
+    USLOSS_Console("%s(): waiting on the word\n", arg);
+    result = FutexWait(&word, 0);
+    USLOSS_Console("%s(): FutexWait returned %d\n", arg, result);
+
+    return 9;
+}
+
+
+int Consumer(char *arg)
+{
+    USLOSS_Console("Consumer(): P'ing the USem twice\n");
+    USemP(&usem);
+    USLOSS_Console("Consumer(): got the first unit\n");
+    USemP(&usem);
+    USLOSS_Console("Consumer(): got the second unit\n");
+
+    return 9;
+}